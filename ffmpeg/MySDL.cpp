@@ -1,11 +1,25 @@
 #include "MySDL.h"
 
+// a frame later than this once rendered is dropped
+#define MAX_LATENESS 10000
+// but never more than this many in a row, the picture has to move
+#define MAX_DROPPED_FRAMES 5
+// timestamps further apart than this, or a player this far behind, start a new timeline
+#define MAX_PTS_JUMP 1000000
+
 MySDL::MySDL(int width, int height)
 	:m_width(width),
 	m_height(height),
 	m_sdlRenderer(NULL),
 	m_sdlTexture(NULL),
-	m_screen(NULL)
+	m_screen(NULL),
+	m_textureWidth(0),
+	m_textureHeight(0),
+	m_startTime(0),
+	m_startPts(AV_NOPTS_VALUE),
+	m_lastPts(AV_NOPTS_VALUE),
+	m_renderCost(0),
+	m_droppedFrames(0)
 {
 	m_sdlRect = new SDL_Rect();
 }
@@ -21,31 +35,91 @@ void MySDL::Init()
 		SDL_WINDOW_OPENGL);
 
 	m_sdlRenderer = SDL_CreateRenderer(m_screen, -1, 0);
-	m_sdlTexture = SDL_CreateTexture(m_sdlRenderer, SDL_PIXELFORMAT_IYUV,
-		SDL_TEXTUREACCESS_STREAMING,
-		m_width, m_height);
+	UpdateTexture(m_width, m_height);
 	m_sdlRect->x = 0;
 	m_sdlRect->y = 0;
 	m_sdlRect->w = m_width;
 	m_sdlRect->h = m_height;
 }
 
+// The texture follows the size of the frames, the window stays as it is and
+// the frames are stretched to it.
+bool MySDL::UpdateTexture(int width, int height)
+{
+	if (m_sdlTexture && width == m_textureWidth && height == m_textureHeight)
+		return true;
+	if (m_sdlTexture)
+		SDL_DestroyTexture(m_sdlTexture);
+	m_sdlTexture = SDL_CreateTexture(m_sdlRenderer, SDL_PIXELFORMAT_IYUV,
+		SDL_TEXTUREACCESS_STREAMING,
+		width, height);
+	m_textureWidth = m_sdlTexture ? width : 0;
+	m_textureHeight = m_sdlTexture ? height : 0;
+	return m_sdlTexture != NULL;
+}
+
 void MySDL::Render(AVFrame* yuvFrame)
 {
+	int64_t start = Now();
+
+	if (!UpdateTexture(yuvFrame->width, yuvFrame->height))
+		return;
 	SDL_UpdateYUVTexture(m_sdlTexture,
-		m_sdlRect,
+		NULL,
 		yuvFrame->data[0],
 		yuvFrame->linesize[0],
 		yuvFrame->data[1],
 		yuvFrame->linesize[1],
 		yuvFrame->data[2],
 		yuvFrame->linesize[2]);
-	SDL_RenderClear(m_sdlRenderer);
+	// the texture covers the whole window, nothing to clear
 	SDL_RenderCopy(m_sdlRenderer, m_sdlTexture,
 		NULL, m_sdlRect);
 	SDL_RenderPresent(m_sdlRenderer);
+	m_renderCost += (Now() - start - m_renderCost) / 8;
+}
+
+int64_t MySDL::Now()
+{
+	static const double toMicroseconds = 1000000.0 / SDL_GetPerformanceFrequency();
+	return (int64_t)(SDL_GetPerformanceCounter() * toMicroseconds);
+}
+
+// Paces the frames from their timestamps: the first one shown sets the origin,
+// each next one is presented when its distance to it has elapsed, started
+// early by the time rendering takes.
+bool MySDL::WaitFrame(int64_t pts, AVRational timeBase)
+{
+	int64_t now, due;
+
+	if (pts == AV_NOPTS_VALUE)
+	{
+		Delay();
+		return true;
+	}
+	pts = av_rescale_q(pts, timeBase, AVRational{ 1, 1000000 });
+	now = Now();
+	if (m_startPts == AV_NOPTS_VALUE || pts < m_lastPts || pts - m_lastPts > MAX_PTS_JUMP ||
+		now - (m_startTime + pts - m_startPts) > MAX_PTS_JUMP)
+	{
+		m_startPts = pts;
+		m_startTime = now + m_renderCost;
+	}
+	m_lastPts = pts;
+
+	due = m_startTime + pts - m_startPts - m_renderCost;
+	if (now > due + MAX_LATENESS && m_droppedFrames < MAX_DROPPED_FRAMES)
+	{
+		m_droppedFrames++;
+		return false;
+	}
+	m_droppedFrames = 0;
+	if (due > now)
+		SDL_Delay((Uint32)((due - now) / 1000));
+	return true;
 }
 
+// For frames without timestamp, assumes 25 frames per second.
 void MySDL::Delay()
 {
 	SDL_Delay(40);
@@ -53,5 +127,16 @@ void MySDL::Delay()
 
 void MySDL::Close()
 {
+	if (m_sdlTexture)
+		SDL_DestroyTexture(m_sdlTexture);
+	if (m_sdlRenderer)
+		SDL_DestroyRenderer(m_sdlRenderer);
+	if (m_screen)
+		SDL_DestroyWindow(m_screen);
+	m_sdlTexture = NULL;
+	m_sdlRenderer = NULL;
+	m_screen = NULL;
+	delete m_sdlRect;
+	m_sdlRect = NULL;
 	SDL_Quit();
 }
@@ -15,9 +15,15 @@ public:
 	MySDL(int width, int height);
 	void Init();
 	void Render(AVFrame* yuvFrame);
+	// Waits until the frame with this timestamp is due, false if it is too late to show it.
+	bool WaitFrame(int64_t pts, AVRational timeBase);
 	void Delay();
 	void Close();
 
+private:
+	bool UpdateTexture(int width, int height);
+	static int64_t Now();
+
 private:
 	SDL_Window* m_screen;
 	int m_width;
@@ -25,5 +31,12 @@ private:
 	SDL_Renderer* m_sdlRenderer;
 	SDL_Texture* m_sdlTexture;
 	SDL_Rect* m_sdlRect;
+	int m_textureWidth;
+	int m_textureHeight;
+	int64_t m_startTime;	// when the first frame was due, in microseconds
+	int64_t m_startPts;		// and its timestamp
+	int64_t m_lastPts;
+	int64_t m_renderCost;	// average time Render() takes
+	int m_droppedFrames;	// late frames dropped in a row
 };
 
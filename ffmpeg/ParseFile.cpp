@@ -0,0 +1,235 @@
+#include "ParseFile.h"
+#include <utility>
+
+ParseFile::ParseFile(const string& fileName)
+	:m_fileName(fileName),
+	m_formatCtx(nullptr),
+	m_videoPacket(nullptr),
+	m_videoIndex(-1),
+	m_rawFrame(nullptr),
+	m_codecCtx(nullptr),
+	m_swsContext(nullptr),
+	m_draining(false)
+{
+}
+
+ParseFile::~ParseFile()
+{
+	Close();
+}
+
+ParseFile::ParseFile(ParseFile&& other) noexcept
+	:m_fileName(std::move(other.m_fileName)),
+	m_formatCtx(std::exchange(other.m_formatCtx, nullptr)),
+	m_videoPacket(std::exchange(other.m_videoPacket, nullptr)),
+	m_videoIndex(std::exchange(other.m_videoIndex, -1)),
+	m_rawFrame(std::exchange(other.m_rawFrame, nullptr)),
+	m_codecCtx(std::exchange(other.m_codecCtx, nullptr)),
+	m_swsContext(std::exchange(other.m_swsContext, nullptr)),
+	m_draining(std::exchange(other.m_draining, false))
+{
+}
+
+ParseFile& ParseFile::operator=(ParseFile&& other) noexcept
+{
+	if (this != &other)
+	{
+		Close();
+		m_fileName = std::move(other.m_fileName);
+		m_formatCtx = std::exchange(other.m_formatCtx, nullptr);
+		m_videoPacket = std::exchange(other.m_videoPacket, nullptr);
+		m_videoIndex = std::exchange(other.m_videoIndex, -1);
+		m_rawFrame = std::exchange(other.m_rawFrame, nullptr);
+		m_codecCtx = std::exchange(other.m_codecCtx, nullptr);
+		m_swsContext = std::exchange(other.m_swsContext, nullptr);
+		m_draining = std::exchange(other.m_draining, false);
+	}
+	return *this;
+}
+
+bool ParseFile::Init()
+{
+	return OpenFile()
+		&& FindStream()
+		&& LocateVideoStream()
+		&& CreateCodecContext()
+		&& InitFrame()
+		&& AllocatePacket();
+}
+
+bool ParseFile::OpenFile()
+{
+	if (avformat_open_input(&m_formatCtx, m_fileName.c_str(), nullptr, nullptr) < 0)
+	{
+		cout << "Couldn't open input stream " << m_fileName << endl;
+		return false;
+	}
+	return true;
+}
+
+bool ParseFile::FindStream()
+{
+	if (avformat_find_stream_info(m_formatCtx, nullptr) < 0)
+	{
+		cout << "Couldn't find stream information" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool ParseFile::LocateVideoStream()
+{
+	m_videoIndex = av_find_best_stream(m_formatCtx, AVMEDIA_TYPE_VIDEO, -1, -1, nullptr, 0);
+	if (m_videoIndex < 0)
+	{
+		cout << "Didn't find a video stream" << endl;
+		return false;
+	}
+	// the demuxer does not need to return packets nobody decodes
+	for (unsigned int i = 0; i < m_formatCtx->nb_streams; i++)
+	{
+		if ((int)i != m_videoIndex)
+			m_formatCtx->streams[i]->discard = AVDISCARD_ALL;
+	}
+	return true;
+}
+
+bool ParseFile::CreateCodecContext()
+{
+	AVCodecParameters* codecpar = m_formatCtx->streams[m_videoIndex]->codecpar;
+	const AVCodec* codec = avcodec_find_decoder(codecpar->codec_id);
+	AVDictionary* opts = nullptr;
+	int ret;
+
+	if (!codec)
+	{
+		cout << "Codec not found" << endl;
+		return false;
+	}
+	m_codecCtx = avcodec_alloc_context3(codec);
+	if (!m_codecCtx || avcodec_parameters_to_context(m_codecCtx, codecpar) < 0)
+		return false;
+	m_codecCtx->pkt_timebase = m_formatCtx->streams[m_videoIndex]->time_base;
+
+	av_dict_set(&opts, "threads", "auto", 0);
+	ret = avcodec_open2(m_codecCtx, codec, &opts);
+	av_dict_free(&opts);
+	if (ret < 0)
+	{
+		cout << "Could not open codec" << endl;
+		return false;
+	}
+	return true;
+}
+
+bool ParseFile::InitFrame()
+{
+	m_rawFrame = av_frame_alloc();
+	return m_rawFrame != nullptr;
+}
+
+bool ParseFile::AllocatePacket()
+{
+	m_videoPacket = av_packet_alloc();
+	return m_videoPacket != nullptr;
+}
+
+bool ParseFile::InitSwScaleContext(int width, int height, AVPixelFormat format)
+{
+	m_swsContext = sws_getCachedContext(m_swsContext,
+		m_rawFrame->width, m_rawFrame->height, (AVPixelFormat)m_rawFrame->format,
+		width, height, format, SWS_BICUBIC, nullptr, nullptr, nullptr);
+	return m_swsContext != nullptr;
+}
+
+bool ParseFile::ReadData()
+{
+	int ret;
+
+	if (!m_codecCtx)
+		return false;
+	av_frame_unref(m_rawFrame);
+	for (;;)
+	{
+		ret = avcodec_receive_frame(m_codecCtx, m_rawFrame);
+		if (ret >= 0)
+			return true;
+		if (ret != AVERROR(EAGAIN) || m_draining)
+			return false;
+		if (!DecodeData())
+			return false;
+	}
+}
+
+// Feeds the decoder with the next video packet, or with the end of stream
+// once the file is read.
+bool ParseFile::DecodeData()
+{
+	int ret;
+
+	while ((ret = av_read_frame(m_formatCtx, m_videoPacket)) >= 0)
+	{
+		if (m_videoPacket->stream_index == m_videoIndex)
+			break;
+		av_packet_unref(m_videoPacket);
+	}
+	if (ret < 0)
+	{
+		m_draining = true;
+		return avcodec_send_packet(m_codecCtx, nullptr) >= 0;
+	}
+	ret = avcodec_send_packet(m_codecCtx, m_videoPacket);
+	av_packet_unref(m_videoPacket);
+	// a damaged packet only costs its frame
+	return ret >= 0 || ret == AVERROR_INVALIDDATA;
+}
+
+bool ParseFile::ConvertVideo(uint8_t* const data[], const int linesize[], int width, int height, AVPixelFormat format)
+{
+	if (!m_rawFrame || !m_rawFrame->data[0])
+		return false;
+	if (!InitSwScaleContext(width, height, format))
+		return false;
+	return sws_scale(m_swsContext, m_rawFrame->data, m_rawFrame->linesize, 0, m_rawFrame->height,
+		data, linesize) > 0;
+}
+
+void ParseFile::Close()
+{
+	sws_freeContext(m_swsContext);
+	m_swsContext = nullptr;
+	av_frame_free(&m_rawFrame);
+	av_packet_free(&m_videoPacket);
+	avcodec_free_context(&m_codecCtx);
+	avformat_close_input(&m_formatCtx);
+	m_videoIndex = -1;
+	m_draining = false;
+}
+
+int ParseFile::GetWidth()
+{
+	return m_codecCtx ? m_codecCtx->width : 0;
+}
+
+int ParseFile::GetHeight()
+{
+	return m_codecCtx ? m_codecCtx->height : 0;
+}
+
+AVPixelFormat ParseFile::GetPixelFormat()
+{
+	return m_codecCtx ? m_codecCtx->pix_fmt : AV_PIX_FMT_NONE;
+}
+
+AVFrame* ParseFile::GetFrame()
+{
+	return m_rawFrame && m_rawFrame->data[0] ? m_rawFrame : nullptr;
+}
+
+bool ParseFile::RefFrame(AVFrame* dst)
+{
+	if (!GetFrame())
+		return false;
+	av_frame_unref(dst);
+	return av_frame_ref(dst, m_rawFrame) >= 0;
+}
@@ -13,18 +13,33 @@ extern "C"
 using namespace std;
 
 
+// Decodes the video stream of a file one frame at a time. The frames are the
+// ref-counted ones of the decoder, converting them is left to the caller.
 class ParseFile
 {
 public:
-	ParseFile(string fileNmae);
+	explicit ParseFile(const string& fileName);
+	~ParseFile();
+
+	ParseFile(ParseFile&& other) noexcept;
+	ParseFile& operator=(ParseFile&& other) noexcept;
+	ParseFile(const ParseFile&) = delete;
+	ParseFile& operator=(const ParseFile&) = delete;
 
 	bool Init();
+	// Decodes the next frame, false at the end of the file or on error.
 	bool ReadData();
 	void Close();
 
 	int GetWidth();
 	int GetHeight();
+	AVPixelFormat GetPixelFormat();
+	// The last decoded frame, valid until the next ReadData().
 	AVFrame* GetFrame();
+	// Makes dst a new reference to the last decoded frame, to keep it longer.
+	bool RefFrame(AVFrame* dst);
+	// Converts the last decoded frame into buffers of the caller.
+	bool ConvertVideo(uint8_t* const data[], const int linesize[], int width, int height, AVPixelFormat format);
 
 private:
 	bool OpenFile();
@@ -32,11 +47,10 @@ private:
 	bool LocateVideoStream();
 	bool CreateCodecContext();
 	bool InitFrame();
-	bool InitSwScaleContext();
+	bool InitSwScaleContext(int width, int height, AVPixelFormat format);
 	bool AllocatePacket();
 
 	bool DecodeData();
-	bool ConvertVideo();
 
 private:
 	string m_fileName;
@@ -44,9 +58,8 @@ private:
 	AVPacket* m_videoPacket;
 	int m_videoIndex;
 	AVFrame* m_rawFrame;
-	AVFrame* m_yuvFrame;
 	AVCodecContext* m_codecCtx;
 	SwsContext* m_swsContext;
-	uint8_t* m_data;
+	bool m_draining;
 };
 
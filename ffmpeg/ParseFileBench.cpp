@@ -0,0 +1,50 @@
+#include "ParseFile.h"
+#include <chrono>
+#include <utility>
+
+// Decodes a file twice with ParseFile, cuc.flv unless another one is given,
+// and reports how many frames a second it delivers as decoded and once
+// converted to YUV420P, to compare the cost of the conversion.
+static bool Measure(const string& fileName, bool convert)
+{
+	ParseFile parser(fileName);
+	uint8_t* data[4] = { nullptr };
+	int linesize[4] = { 0 };
+	int frames = 0;
+
+	if (!parser.Init())
+		return false;
+	// moving the decoder hands over what it owns, the moved-from one is empty
+	ParseFile decoder(std::move(parser));
+	if (convert && av_image_alloc(data, linesize, decoder.GetWidth(), decoder.GetHeight(), AV_PIX_FMT_YUV420P, 32) < 0)
+		return false;
+
+	auto start = chrono::steady_clock::now();
+	while (decoder.ReadData())
+	{
+		if (convert && !decoder.ConvertVideo(data, linesize, decoder.GetWidth(), decoder.GetHeight(), AV_PIX_FMT_YUV420P))
+			break;
+		frames++;
+	}
+	double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+	av_freep(&data[0]);
+
+	if (!frames)
+	{
+		cout << "No frame decoded from " << fileName << endl;
+		return false;
+	}
+	cout << fileName << (convert ? " converted: " : " decoded: ") << frames << " frames of "
+		<< decoder.GetWidth() << "x" << decoder.GetHeight() << " in " << seconds * 1000 << " ms, "
+		<< frames / seconds << " frames per second" << endl;
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	string fileName = argc > 1 ? argv[1] : "cuc.flv";
+
+	if (!Measure(fileName, false) || !Measure(fileName, true))
+		return 1;
+	return 0;
+}
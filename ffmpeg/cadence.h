@@ -0,0 +1,53 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * refresh intervals pictures stay on screen with -cadence, kept apart from ffplay.c so that
+ * cadence_test.c can check them without the libraries
+ */
+
+#ifndef FFPLAY_CADENCE_H
+#define FFPLAY_CADENCE_H
+
+#include <math.h>
+
+/* Number of refresh intervals a picture of the given duration stays on screen. What rounding takes from
+ * a picture is given to the next ones, so that 24 pictures a second on a 60 Hz display go 3, 2, 3, 2. */
+static inline int cadence_slots(double duration, double interval, double *frac)
+{
+    double exact = duration / interval + *frac;
+    int slots = (int)floor(exact + 0.5);
+
+    if (slots < 0)
+        slots = 0;
+    *frac = exact - slots;
+    return slots;
+}
+
+/* Schedule the picture picked to be shown next: its time on screen goes to *delay, and the refresh
+ * intervals it gets are returned, 0 for a picture to skip without rendering it. */
+static inline int cadence_schedule(double duration, double interval, double *frac, double *delay)
+{
+    int slots = cadence_slots(duration, interval, frac);
+
+    *delay = slots * interval;
+    return slots;
+}
+
+#endif /* FFPLAY_CADENCE_H */
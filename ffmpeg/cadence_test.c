@@ -0,0 +1,195 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * Check of the -cadence scheduling on a simulated display, built on its own:
+ *     cc -o cadence_test cadence_test.c -lm && ./cadence_test
+ */
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cadence.h"
+
+#define NB_PICTURES 100000
+
+/* the first pictures of a rate on a refresh rate must stay on screen for the given slots */
+static int check_pattern(double fps, double hz, const int *pattern, int nb)
+{
+    double frac = 0;
+    int i, slots;
+
+    for (i = 0; i < nb; i++) {
+        slots = cadence_slots(1 / fps, 1 / hz, &frac);
+        if (slots != pattern[i]) {
+            printf("%g fps on %g Hz: picture %d for %d intervals instead of %d\n", fps, hz, i, slots, pattern[i]);
+            return 1;
+        }
+    }
+    printf("%g fps on %g Hz: pattern ok\n", fps, hz);
+    return 0;
+}
+
+/* the pictures shown must never be more than half a refresh interval away from their timestamps */
+static int check_drift(double fps, double hz)
+{
+    double frac = 0, drift, max_drift = 0;
+    int64_t shown = 0;
+    int i;
+
+    for (i = 1; i <= NB_PICTURES; i++) {
+        shown += cadence_slots(1 / fps, 1 / hz, &frac);
+        drift = fabs(shown - i * hz / fps);
+        if (drift > max_drift)
+            max_drift = drift;
+    }
+    printf("%g fps on %g Hz: largest drift %0.3f intervals\n", fps, hz, max_drift);
+    return max_drift > 0.5 + 1e-6;
+}
+
+/* the part of video_refresh scheduling the pictures with -cadence, on a display presenting on its vsyncs */
+typedef struct Display {
+    double interval;
+    double time;                /* simulated clock */
+    double frame_timer;
+    double frac, delay;
+    int known;
+    int next;                   /* picture to pick next */
+} Display;
+
+#define SYNC_THRESHOLD_MAX 0.1
+#define REFRESH_RATE 0.01
+
+static double display_snap(Display *d, double time)
+{
+    return round(time / d->interval) * d->interval;
+}
+
+/* one call of video_refresh for pictures coming at fps, returns the picture rendered or -1, slots[] gets
+ * the refresh intervals given to each picture picked */
+static int display_refresh(Display *d, double fps, int *slots, double *remaining_time)
+{
+    double delay, early = d->interval / 2;
+
+    if (!d->next)
+        d->frame_timer = display_snap(d, d->time);
+    for (;;) {
+        delay = d->known ? d->delay : 0;
+        if (d->time < d->frame_timer + delay - early) {
+            *remaining_time = fmin(d->frame_timer + delay - early - d->time, *remaining_time);
+            return -1;
+        }
+        d->frame_timer += delay;
+        if (delay > 0 && d->time - d->frame_timer > SYNC_THRESHOLD_MAX)
+            d->frame_timer = d->time;
+        d->frame_timer = display_snap(d, d->frame_timer);
+
+        slots[d->next] = cadence_schedule(1 / fps, d->interval, &d->frac, &d->delay);
+        d->known = 1;
+        if (slots[d->next]) {
+            /* rendered, the present returns at the next vsync */
+            d->time = (floor(d->time / d->interval + 1e-6) + 1) * d->interval;
+            return d->next++;
+        }
+        d->next++;
+    }
+}
+
+/* Pictures at fps on a hz display: each picture rendered must stay on screen for the refresh intervals it was
+ * given, so that no present is spent on a picture given none, and it must appear within half an interval of
+ * its timestamp. The intervals given to the first pictures must follow the pattern. */
+static int check_display(double fps, double hz, const int *pattern, int nb)
+{
+    static int slots[NB_PICTURES];
+    Display d = { 0 };
+    double remaining_time = 0, first = 0, drift, max_drift = 0;
+    int64_t vsync, last_vsync = -1;
+    int i, pic, last = -1, nb_skipped = 0;
+
+    d.interval = 1 / hz;
+    /* the first refresh is half an interval before a vsync */
+    d.time = d.interval * 0.6;
+    while (d.next < NB_PICTURES) {
+        if (remaining_time > 0)
+            d.time += fmax(remaining_time, 1e-6);
+        remaining_time = REFRESH_RATE;
+        if ((pic = display_refresh(&d, fps, slots, &remaining_time)) < 0)
+            continue;
+
+        vsync = (int64_t)floor(d.time / d.interval + 0.5);
+        if (last < 0)
+            first = d.time - pic / fps;
+        else if (vsync - last_vsync != slots[last]) {
+            printf("%g fps on %g Hz: picture %d on screen for %d intervals instead of %d\n",
+                   fps, hz, last, (int)(vsync - last_vsync), slots[last]);
+            return 1;
+        }
+        drift = fabs(d.time - first - pic / fps) / d.interval;
+        if (drift > max_drift)
+            max_drift = drift;
+        last       = pic;
+        last_vsync = vsync;
+    }
+
+    for (i = 0; i < nb; i++) {
+        if (slots[i] != pattern[i]) {
+            printf("%g fps on %g Hz: picture %d given %d intervals instead of %d\n", fps, hz, i, slots[i], pattern[i]);
+            return 1;
+        }
+    }
+    for (i = 0; i < d.next; i++)
+        nb_skipped += !slots[i];
+    printf("%g fps on %g Hz: %d pictures skipped, largest drift on screen %0.3f intervals\n",
+           fps, hz, nb_skipped, max_drift);
+    return max_drift > 0.5 + 1e-6;
+}
+
+int main(void)
+{
+    static const int film_60[] = { 3, 2, 3, 2, 3, 2, 3, 2 };
+    static const int pal_60[]  = { 2, 3, 2, 3, 2 };
+    static const int ntsc_60[] = { 2, 2, 2, 2 };
+    static const int film_48[] = { 2, 2, 2, 2 };
+    static const int high_60[] = { 1, 0, 1, 0 };
+    static const int high_50[] = { 1, 1, 0, 1, 1, 1 };
+    int ret = 0;
+
+    ret |= check_pattern(24, 60, film_60, 8);
+    ret |= check_pattern(25, 60, pal_60, 5);
+    ret |= check_pattern(30, 60, ntsc_60, 4);
+    ret |= check_pattern(24, 48, film_48, 4);
+    ret |= check_pattern(120, 60, high_60, 4);
+
+    ret |= check_drift(24, 60);
+    ret |= check_drift(24000 / 1001., 60);
+    ret |= check_drift(24000 / 1001., 60000 / 1001.);
+    ret |= check_drift(25, 60);
+    ret |= check_drift(30, 144);
+    ret |= check_drift(50, 60);
+
+    ret |= check_display(24, 60, film_60, 8);
+    ret |= check_display(30, 60, ntsc_60, 4);
+    ret |= check_display(120, 60, high_60, 4);
+    ret |= check_display(60, 50, high_50, 6);
+    ret |= check_display(24000 / 1001., 60, film_60, 8);
+
+    printf(ret ? "FAILED\n" : "all passed\n");
+    return ret;
+}
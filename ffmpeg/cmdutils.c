@@ -63,6 +63,12 @@
 #ifdef _WIN32
 #include <windows.h>
 #endif
+#if HAVE_PTHREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define LOG_ASYNC (HAVE_W32THREADS || HAVE_PTHREADS)
 
 static int init_report(const char *env);
 
@@ -109,6 +115,229 @@ static void log_callback_report(void *ptr, int level, const char *fmt, va_list v
     }
 }
 
+#if LOG_ASYNC
+/*
+ * Asynchronous logging: the threads logging format their lines into rings
+ * and a background thread writes them to stderr and to the report file.
+ * Each thread gets a ring of its own, threads beyond LOG_RINGS share them.
+ * A ring is a bounded lock-free queue: a record is claimed by a compare and
+ * swap of the head and published by its sequence number, so the threads
+ * logging never wait. When a ring is full the line is dropped and counted.
+ */
+#define LOG_RINGS      16
+#define LOG_RING_SIZE  128              /* power of 2 */
+#define LOG_LINE_SIZE  1024
+#define LOG_POLL_MS    5
+#define LOG_STOP_WAIT_MS 1000           /* longest wait at exit for the threads still logging */
+
+typedef struct LogRecord {
+    volatile long seq;                  /* position the record is free or published for */
+    long order;                         /* of the line among all the lines */
+    int level;
+    char line[LOG_LINE_SIZE];
+} LogRecord;
+
+typedef struct LogRing {
+    volatile long head;                 /* next position claimed by a thread logging */
+    long tail;                          /* next position written by the background thread */
+    LogRecord records[LOG_RING_SIZE];
+} LogRing;
+
+static LogRing *log_rings;
+static volatile long log_nb_threads;
+static volatile long log_order;
+static volatile long log_dropped;
+static volatile long log_writers;       /* threads inside log_callback_async() */
+static volatile int log_stop;
+static volatile int log_closed;         /* lines go straight out, the rings are drained */
+
+#ifdef _MSC_VER
+#define LOG_THREAD_LOCAL __declspec(thread)
+#else
+#define LOG_THREAD_LOCAL __thread
+#endif
+static LOG_THREAD_LOCAL int log_ring_index;     /* ring of the thread plus 1, 0 before its first line */
+static LOG_THREAD_LOCAL int log_print_prefix = 1;
+
+#if HAVE_W32THREADS
+static HANDLE log_thread;
+#define log_atomic_cas(ptr, old, new) InterlockedCompareExchange(ptr, new, old)
+#define log_atomic_inc(ptr)           InterlockedIncrement(ptr)
+#define log_atomic_dec(ptr)           InterlockedDecrement(ptr)
+#define log_barrier()                 MemoryBarrier()
+#define log_sleep_ms(ms)              Sleep(ms)
+#else
+static pthread_t log_thread;
+#define log_atomic_cas(ptr, old, new) __sync_val_compare_and_swap(ptr, old, new)
+#define log_atomic_inc(ptr)           __sync_add_and_fetch(ptr, 1)
+#define log_atomic_dec(ptr)           __sync_sub_and_fetch(ptr, 1)
+#define log_barrier()                 __sync_synchronize()
+#define log_sleep_ms(ms)              usleep((ms) * 1000)
+#endif
+
+static void log_ring_write(void *ptr, int level, const char *fmt, va_list vl)
+{
+    LogRing *ring;
+    LogRecord *rec;
+    long pos, seq;
+
+    if (!log_ring_index)
+        log_ring_index = (log_atomic_inc(&log_nb_threads) - 1) % LOG_RINGS + 1;
+    ring = &log_rings[log_ring_index - 1];
+
+    pos = ring->head;
+    for (;;) {
+        rec = &ring->records[pos & (LOG_RING_SIZE - 1)];
+        seq = rec->seq;
+        log_barrier();
+        if (seq == pos) {
+            if (log_atomic_cas(&ring->head, pos, pos + 1) == pos)
+                break;
+            pos = ring->head;
+        } else if (seq - pos < 0) {
+            log_atomic_inc(&log_dropped);
+            return;
+        } else {
+            pos = ring->head;
+        }
+    }
+    rec->level = level;
+    rec->order = log_atomic_inc(&log_order);
+    av_log_format_line(ptr, level, fmt, vl, rec->line, sizeof(rec->line), &log_print_prefix);
+    log_barrier();
+    rec->seq = pos + 1;
+}
+
+/* A thread may have fetched this callback just before log_async_stop() replaced it. It is counted
+ * in log_writers before it looks at log_closed, so that log_async_stop() either waits for its line
+ * or the line is written directly. */
+static void log_callback_async(void *ptr, int level, const char *fmt, va_list vl)
+{
+    if (level > av_log_get_level() && (!report_file || level > report_file_level))
+        return;
+    log_atomic_inc(&log_writers);
+    if (log_closed) {
+        if (report_file)
+            log_callback_report(ptr, level, fmt, vl);
+        else
+            av_log_default_callback(ptr, level, fmt, vl);
+    } else {
+        log_ring_write(ptr, level, fmt, vl);
+    }
+    log_atomic_dec(&log_writers);
+}
+
+/* write the oldest line published, returns 0 if there is none */
+static int log_write_next(void)
+{
+    LogRecord *rec, *next = NULL;
+    LogRing *ring, *next_ring = NULL;
+    int i;
+
+    for (i = 0; i < LOG_RINGS; i++) {
+        ring = &log_rings[i];
+        rec = &ring->records[ring->tail & (LOG_RING_SIZE - 1)];
+        if (rec->seq != ring->tail + 1)
+            continue;
+        if (!next || rec->order - next->order < 0) {
+            next = rec;
+            next_ring = ring;
+        }
+    }
+    if (!next)
+        return 0;
+    log_barrier();
+    av_log_default_callback(NULL, next->level, "%s", next->line);
+    if (report_file && report_file_level >= next->level)
+        fputs(next->line, report_file);
+    log_barrier();
+    next->seq = next_ring->tail + LOG_RING_SIZE;
+    next_ring->tail++;
+    return 1;
+}
+
+static void log_write_all(void)
+{
+    long dropped;
+
+    while (log_write_next())
+        ;
+    if ((dropped = log_dropped)) {
+        log_atomic_cas(&log_dropped, dropped, 0);
+        av_log_default_callback(NULL, AV_LOG_WARNING, "%ld log lines dropped\n", dropped);
+        if (report_file)
+            fprintf(report_file, "%ld log lines dropped\n", dropped);
+    }
+    if (report_file)
+        fflush(report_file);
+}
+
+#if HAVE_W32THREADS
+static DWORD WINAPI log_thread_main(void *arg)
+#else
+static void *log_thread_main(void *arg)
+#endif
+{
+    while (!log_stop) {
+        log_write_all();
+        log_sleep_ms(LOG_POLL_MS);
+    }
+    return 0;
+}
+
+static void log_async_stop(void)
+{
+    int waited;
+
+    log_stop = 1;
+#if HAVE_W32THREADS
+    WaitForSingleObject(log_thread, INFINITE);
+    CloseHandle(log_thread);
+#else
+    pthread_join(log_thread, NULL);
+#endif
+    av_log_set_callback(report_file ? log_callback_report : av_log_default_callback);
+    log_closed = 1;
+    log_barrier();
+    for (waited = 0; log_writers && waited < LOG_STOP_WAIT_MS; waited += LOG_POLL_MS)
+        log_sleep_ms(LOG_POLL_MS);
+    log_barrier();
+    log_write_all();
+    /* a thread stuck in the middle of a line keeps the rings */
+    if (!log_writers)
+        av_freep(&log_rings);
+}
+
+/* Switch the av_log output to the background thread, once. */
+static void log_async_start(void)
+{
+    int i, j;
+
+    if (log_rings)
+        return;
+    if (!(log_rings = av_mallocz(LOG_RINGS * sizeof(*log_rings))))
+        return;
+    for (i = 0; i < LOG_RINGS; i++)
+        for (j = 0; j < LOG_RING_SIZE; j++)
+            log_rings[i].records[j].seq = j;
+#if HAVE_W32THREADS
+    log_thread = CreateThread(NULL, 0, log_thread_main, NULL, 0, NULL);
+    if (!log_thread) {
+#else
+    if (pthread_create(&log_thread, NULL, log_thread_main, NULL)) {
+#endif
+        av_freep(&log_rings);
+        return;
+    }
+    atexit(log_async_stop);
+    av_log_set_callback(log_callback_async);
+}
+#else
+static void log_async_start(void)
+{
+}
+#endif
+
 void init_dynload(void)
 {
 #if HAVE_SETDLLDIRECTORY && defined(_WIN32)
@@ -518,6 +747,9 @@ void parse_loglevel(int argc, char **argv, const OptionDef *options)
             fflush(report_file);
         }
     }
+    /* the report is written from the background thread so that it does not slow down the threads logging */
+    if (report_file || locate_option(argc, argv, options, "asynclog"))
+        log_async_start();
     idx = locate_option(argc, argv, options, "hide_banner");
     if (idx)
         hide_banner = 1;
@@ -1057,6 +1289,12 @@ int opt_report(void *optctx, const char *opt, const char *arg)
     return init_report(NULL);
 }
 
+int opt_asynclog(void *optctx, const char *opt, const char *arg)
+{
+    log_async_start();
+    return 0;
+}
+
 int opt_max_alloc(void *optctx, const char *opt, const char *arg)
 {
     char *tail;
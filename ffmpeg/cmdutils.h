@@ -106,6 +106,12 @@ int opt_loglevel(void *optctx, const char *opt, const char *arg);
 
 int opt_report(void *optctx, const char *opt, const char *arg);
 
+/**
+ * Write the log from a background thread, the threads logging only
+ * format their lines into lock-free rings.
+ */
+int opt_asynclog(void *optctx, const char *opt, const char *arg);
+
 int opt_max_alloc(void *optctx, const char *opt, const char *arg);
 
 int opt_codec_debug(void *optctx, const char *opt, const char *arg);
@@ -242,6 +248,7 @@ void show_help_options(const OptionDef *options, const char *msg, int req_flags,
     { "loglevel",    HAS_ARG,              { .func_arg = opt_loglevel },     "set logging level", "loglevel" },         \
     { "v",           HAS_ARG,              { .func_arg = opt_loglevel },     "set logging level", "loglevel" },         \
     { "report",      0,                    { .func_arg = opt_report },       "generate a report" },                     \
+    { "asynclog",    OPT_EXPERT,           { .func_arg = opt_asynclog },     "write the log from a background thread" }, \
     { "max_alloc",   HAS_ARG,              { .func_arg = opt_max_alloc },    "set maximum size of a single allocated block", "bytes" }, \
     { "cpuflags",    HAS_ARG | OPT_EXPERT, { .func_arg = opt_cpuflags },     "force specific cpu flags", "flags" },     \
     { "cpucount",    HAS_ARG | OPT_EXPERT, { .func_arg = opt_cpucount },     "force specific cpu count", "count" },     \
@@ -29,6 +29,8 @@
 #include <limits.h>
 #include <signal.h>
 #include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 #include "libavutil/avstring.h"
 #include "libavutil/channel_layout.h"
@@ -42,6 +44,8 @@
 #include "libavutil/samplefmt.h"
 #include "libavutil/time.h"
 #include "libavutil/bprint.h"
+#include "libavutil/md5.h"
+#include "libavutil/cpu.h"
 #include "libavformat/avformat.h"
 #include "libavdevice/avdevice.h"
 #include "libswscale/swscale.h"
@@ -55,16 +59,41 @@
 # include "libavfilter/buffersrc.h"
 #endif
 
+#if HAVE_MMAP
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+#elif HAVE_MAPVIEWOFFILE
+# include <windows.h>
+#endif
+
 #include <SDL.h>
 #include <SDL_thread.h>
 
 #include "cmdutils.h"
+#include "cadence.h"
 
 const char program_name[] = "ffplay";
 const int program_birth_year = 2003;
 
 #define MAX_QUEUE_SIZE (15 * 1024 * 1024)
+#define MAX_INPUTS 16
+
+/* size of the read-ahead window kept ahead of the read position of a mapped input file */
+#define MAPPED_FILE_READ_AHEAD (8 * 1024 * 1024)
+/* size of the blocks read by the read-ahead thread */
+#define READ_AHEAD_BLOCK_SIZE (256 * 1024)
+#define INPUT_IO_BUFFER_SIZE 32768
+
+/* probing bounds of -faststart, in bytes and AV_TIME_BASE units */
+#define FAST_START_PROBESIZE (128 * 1024)
+#define FAST_START_ANALYZE_DURATION (500 * 1000)
 #define MIN_FRAMES 25
+/* alternate audio and subtitle streams with a decoder kept open, their packets kept from a bit before
+ * the clock on and up to a number of them */
+#define MAX_ALT_STREAMS 8
+#define ALT_QUEUE_BEHIND 1.0
+#define ALT_QUEUE_PACKETS 512
 #define EXTERNAL_CLOCK_MIN_FRAMES 2
 #define EXTERNAL_CLOCK_MAX_FRAMES 10
 
@@ -87,42 +116,106 @@ const int program_birth_year = 2003;
 
 /* maximum audio speed change to get correct sync */
 #define SAMPLE_CORRECTION_PERCENT_MAX 10
+/* with -cadence the audio follows the video, by at most this fraction of its samples */
+#define CADENCE_SAMPLE_CORRECTION_MAX 0.005
+/* display refresh rate assumed when SDL does not tell */
+#define VSYNC_DEFAULT_RATE 60
+/* weight of a measured present interval in the refresh interval */
+#define VSYNC_WEIGHT 0.02
+/* pictures kept on screen for more refresh intervals than this are counted together */
+#define CADENCE_MAX_SLOTS 4
 
 /* external clock speed adjustment constants for realtime sources based on buffer fullness */
 #define EXTERNAL_CLOCK_SPEED_MIN  0.900
 #define EXTERNAL_CLOCK_SPEED_MAX  1.010
 #define EXTERNAL_CLOCK_SPEED_STEP 0.001
 
+/* live mode: the jitter buffer holds a multiple of the measured arrival jitter, within bounds */
+#define LIVE_JITTER_FACTOR 4
+#define LIVE_MIN_DELAY 0.020
+#define LIVE_MAX_DELAY 0.500
+#define LIVE_INITIAL_DELAY 0.100
+/* queued packets are dropped at the next key frame when the latency exceeds the buffer by this much */
+#define LIVE_DROP_THRESHOLD 0.150
+/* the clock jumps to its target rather than drifting towards it when further than this */
+#define LIVE_RESYNC_THRESHOLD 0.100
+#define LIVE_CLOCK_SPEED_MIN 0.950
+#define LIVE_CLOCK_SPEED_MAX 1.050
+/* smaller audio buffers in live mode, about 10 ms */
+#define LIVE_AUDIO_CALLBACKS_PER_SEC 100
+
+/* video decoded this late against the master clock raises the catch-up level, this early lowers it */
+#define CATCH_UP_BEHIND    0.050
+#define CATCH_UP_CAUGHT_UP (-0.050)
+/* minimum time at a level before raising or lowering it, in microseconds */
+#define CATCH_UP_RAISE_HOLD 250000
+#define CATCH_UP_LOWER_HOLD 1000000
+
 /* we use about AUDIO_DIFF_AVG_NB A-V differences to make the average */
 #define AUDIO_DIFF_AVG_NB   20
 
 /* polls for possible required screen refresh at least this often, should be less than 1/fps */
 #define REFRESH_RATE 0.01
 
-/* NOTE: the size must be big enough to compensate the hardware audio buffersize size */
-/* TODO: We assume that a decoded and resampled frame fits into this buffer */
+/* upper bound of the visualizer sample buffer, which is allocated on demand and sized from
+   the window and the audio buffer sizes, see sample_array_wanted_size() */
 #define SAMPLE_ARRAY_SIZE (8 * 65536)
 
 #define CURSOR_HIDE_DELAY 1000000
 
-#define USE_ONEPASS_SUBTITLE_RENDER 1
+/* minimum size of the texture atlas holding the converted subtitle bitmaps */
+#define SUB_ATLAS_SIZE 2048
+#define SUB_ATLAS_MAX_ENTRIES 64
 
 static unsigned sws_flags = SWS_BICUBIC;
 
+/* ring of packet payloads of a stream, per queue */
+#define VIDEO_PACKET_ARENA_SIZE (8 * 1024 * 1024)
+#define AUDIO_PACKET_ARENA_SIZE (1024 * 1024)
+#define SUBTITLE_PACKET_ARENA_SIZE (256 * 1024)
+#define PACKET_ARENA_ALIGN 64
+#define PACKET_ARENA_SLICES 1024
+
+struct PacketArena;
+
+typedef struct ArenaSlice {
+    struct PacketArena *arena;
+    size_t end;                     /* of the payload in the ring */
+    size_t span;                    /* room taken, the end skipped when it wrapped included */
+    int released;
+} ArenaSlice;
+
+/* Payloads are taken from the head and given back from the tail. A payload released before older
+ * ones keeps its room until those are released as well, which is the rule with in order decoding. */
+typedef struct PacketArena {
+    SDL_mutex *mutex;
+    uint8_t *data;
+    size_t size;
+    size_t head, tail;
+    size_t used;
+    ArenaSlice slices[PACKET_ARENA_SLICES];   /* live slices, oldest first */
+    int first, nb_slices;
+    int refs;                       /* the queue and each live slice */
+} PacketArena;
+
 typedef struct MyAVPacketList {
     AVPacket *pkt;
     int serial;
+    int mem;                        /* memory charged to the queue for the packet */
 } MyAVPacketList;
 
 typedef struct PacketQueue {
     AVFifoBuffer *pkt_list;
     int nb_packets;
-    int size;
+    int size;                       /* memory taken by the queued packets */
     int64_t duration;
     int abort_request;
     int serial;
     SDL_mutex *mutex;
     SDL_cond *cond;
+    PacketArena *arena;
+    int arena_size;                 /* of the arena created with the first payload, 0 for none */
+    int nb_arena_packets, nb_heap_packets;
 } PacketQueue;
 
 #define VIDEO_PICTURE_QUEUE_SIZE 3
@@ -130,6 +223,15 @@ typedef struct PacketQueue {
 #define SAMPLE_QUEUE_SIZE 9
 #define FRAME_QUEUE_SIZE FFMAX(SAMPLE_QUEUE_SIZE, FFMAX(VIDEO_PICTURE_QUEUE_SIZE, SUBPICTURE_QUEUE_SIZE))
 
+/* the picture queue holds from PICTQ_MIN_DEPTH to FRAME_QUEUE_SIZE pictures, the one shown included */
+#define PICTQ_MIN_DEPTH 2
+/* room for decoding times up to this many standard deviations above their mean */
+#define PICTQ_JITTER_SIGMAS 3
+/* weight of a new decoding time in the averages */
+#define PICTQ_COST_WEIGHT 0.05
+/* the depth goes down after the queue was too deep for that long */
+#define PICTQ_SHRINK_HOLD 2000000
+
 typedef struct AudioParams {
     int freq;
     int channels;
@@ -149,6 +251,13 @@ typedef struct Clock {
     int *queue_serial;    /* pointer to the current packet queue serial, used for obsolete clock detection */
 } Clock;
 
+/* Subtitle rect bitmap converted to ARGB by the subtitle thread ahead of its display. */
+typedef struct SubBitmap {
+    uint64_t key;         /* hash of the bitmap and its palette */
+    uint8_t *pixels;      /* NULL for an empty rect */
+    int pitch;
+} SubBitmap;
+
 /* Common struct for handling all types of decoded data and allocated render buffers. */
 typedef struct Frame {
     AVFrame *frame;
@@ -163,6 +272,10 @@ typedef struct Frame {
     AVRational sar;
     int uploaded;
     int flip_v;
+    SubBitmap *sub_bitmaps;
+    int nb_sub_bitmaps;
+    SDL_Rect *sub_rects;      /* location of each subtitle rect bitmap in the subtitle atlas */
+    int sub_atlas_generation;
 } Frame;
 
 typedef struct FrameQueue {
@@ -171,6 +284,7 @@ typedef struct FrameQueue {
     int windex;
     int size;
     int max_size;
+    int depth;                      /* frames queued before the writer waits, at most max_size */
     int keep_last;
     int rindex_shown;
     SDL_mutex *mutex;
@@ -178,6 +292,164 @@ typedef struct FrameQueue {
     PacketQueue *pktq;
 } FrameQueue;
 
+typedef struct SubAtlasEntry {
+    uint64_t key;         /* hash of the bitmap and its palette */
+    int w, h;
+    SDL_Rect rect;
+} SubAtlasEntry;
+
+/* Converted subtitle bitmaps packed on shelves of one texture, reset as a whole when full. */
+typedef struct SubAtlas {
+    SDL_Texture *texture;
+    int width, height;
+    int shelf_x, shelf_y, shelf_h;
+    SubAtlasEntry entries[SUB_ATLAS_MAX_ENTRIES];
+    int nb_entries;
+    int generation;       /* incremented on each reset, invalidates the rects stored in frames */
+    int hits, uploads;
+} SubAtlas;
+
+/* planes of pooled pictures and their lines are aligned to this */
+#define FRAME_POOL_ALIGN 64
+#define FRAME_POOL_PADDING (16 + FRAME_POOL_ALIGN)
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+#ifdef AV_PIX_FMT_FLAG_PSEUDOPAL
+#define FRAME_POOL_UNSUPPORTED (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL | \
+                                AV_PIX_FMT_FLAG_PSEUDOPAL)
+#else
+#define FRAME_POOL_UNSUPPORTED (AV_PIX_FMT_FLAG_HWACCEL | AV_PIX_FMT_FLAG_BITSTREAM | AV_PIX_FMT_FLAG_PAL)
+#endif
+
+/* Buffers holding all the planes of a decoded picture, reused once the picture left the queue. */
+typedef struct FramePool {
+    SDL_mutex *mutex;
+    AVBufferPool *pool;
+    int width, height, format;      /* pictures the pool is sized for */
+    int linesize[4];
+    size_t offset[4];
+    int nb_frames;
+    int nb_allocs;                  /* buffers allocated, each one a heap allocation */
+    int nb_preallocs;               /* of which when the pool was sized */
+} FramePool;
+
+static void frame_pool_uninit(FramePool *fp);
+
+typedef struct MappedFile {
+    const uint8_t *data;
+    int64_t size;
+    int64_t pos;
+    int64_t ahead_start, ahead_end;     /* range last advised for read-ahead */
+#if HAVE_MMAP
+    long page_size;
+#elif HAVE_MAPVIEWOFFILE
+    HANDLE mapping;
+#endif
+} MappedFile;
+
+typedef struct ReadAheadBlock {
+    uint8_t *data;
+    int64_t pos;                /* input offset of data[0] */
+    int size;
+} ReadAheadBlock;
+
+/* Ring of blocks filled by an I/O thread in front of the demuxer read position. The blocks from
+ * rindex on hold nb_filled consecutive parts of the input, the I/O thread only writes the block
+ * after them and the demuxer only reads those. */
+typedef struct ReadAhead {
+    AVIOContext *src;
+    AVIOInterruptCB interrupt_callback;
+    SDL_Thread *thread;
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    ReadAheadBlock *blocks;
+    int nb_blocks;
+    int rindex;
+    int nb_filled;
+    int64_t pos;                /* demuxer read position */
+    int64_t fill_pos;           /* input offset of the next block to fill */
+    int64_t seek_pos;           /* where the I/O thread must restart from, or -1 */
+    int64_t size;
+    int eof;
+    int error;
+    int abort_request;
+
+    int hits;
+    int misses;
+    int64_t stall_time;
+} ReadAhead;
+
+#if CONFIG_AVFILTER
+#define FILTER_GRAPH_CACHE_SIZE 4
+
+typedef struct FilterGraphKey {
+    const char *filters;
+    int width, height;          /* video size, or sample rate and channel count for audio */
+    int format;
+    int64_t channel_layout;
+    AVRational time_base;
+    int scale_width, scale_height;  /* size video is scaled down to in the graph, 0 if it is not */
+} FilterGraphKey;
+
+typedef struct CachedFilterGraph {
+    FilterGraphKey key;
+    AVFilterGraph *graph;
+    AVFilterContext *in, *out;
+    int reusable;               /* holds no frames between its input and output, can be flushed on seek */
+} CachedFilterGraph;
+
+/* Configured filter graphs of one decoder, reused on seeks instead of being rebuilt. */
+typedef struct FilterGraphCache {
+    CachedFilterGraph graphs[FILTER_GRAPH_CACHE_SIZE];
+    int nb_graphs;
+    int nb_builds;
+    int nb_reuses;
+} FilterGraphCache;
+#endif
+
+/* what the video decoder skips to catch up with the master clock */
+typedef struct CatchUpLevel {
+    enum AVDiscard skip_loop_filter;
+    enum AVDiscard skip_idct;
+    enum AVDiscard skip_frame;
+} CatchUpLevel;
+
+static const CatchUpLevel catch_up_levels[] = {
+    { AVDISCARD_DEFAULT, AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_NONREF,  AVDISCARD_DEFAULT, AVDISCARD_DEFAULT },
+    { AVDISCARD_NONREF,  AVDISCARD_NONREF,  AVDISCARD_DEFAULT },
+    { AVDISCARD_ALL,     AVDISCARD_DEFAULT, AVDISCARD_NONREF  },
+    { AVDISCARD_ALL,     AVDISCARD_DEFAULT, AVDISCARD_NONKEY  },
+};
+#define CATCH_UP_LEVELS ((int)FF_ARRAY_ELEMS(catch_up_levels))
+
+enum DecodePolicy {
+    DECODE_POLICY_AUTO,         /* latency for realtime inputs, throughput otherwise */
+    DECODE_POLICY_LATENCY,      /* pictures out as soon as decoded: slice threads, low delay */
+    DECODE_POLICY_THROUGHPUT,   /* frame threads, one picture in flight per thread */
+};
+
+/* pictures up to this size get at most DECODE_SMALL_PICTURE_THREADS frame threads */
+#define DECODE_SMALL_PICTURE (640 * 480)
+#define DECODE_SMALL_PICTURE_THREADS 4
+
+/* time from sending a packet to getting its picture, measured with -benchmark */
+#define DECODE_LATENCY_SLOTS 64
+#define DECODE_LATENCY_MAX_MS 500
+
+typedef struct DecodeLatency {
+    int64_t pts[DECODE_LATENCY_SLOTS];      /* packets in flight in the decoder */
+    int64_t time[DECODE_LATENCY_SLOTS];
+    int next;
+    int histogram[DECODE_LATENCY_MAX_MS + 1];   /* in ms, the last one counts anything longer */
+    int count;
+} DecodeLatency;
+
+enum WindowLayout {
+    LAYOUT_GRID,        /* equal tiles */
+    LAYOUT_MOSAIC,      /* the first input large, the others stacked on its right */
+};
+
 enum {
     AV_SYNC_AUDIO_MASTER, /* default choice */
     AV_SYNC_VIDEO_MASTER,
@@ -197,13 +469,33 @@ typedef struct Decoder {
     int64_t next_pts;
     AVRational next_pts_tb;
     SDL_Thread *decoder_tid;
+    int wanted_lowres;          /* the decoder is reopened with it at the next key frame */
+    int reopening;
+    int64_t packet_wait;        /* time spent waiting for packets to decode, in microseconds */
+    AVCodecContext *retired_avctx;  /* previous decoder, the status line may still be reading it */
+    DecodeLatency *latency;
 } Decoder;
 
+/* a track not played, demuxed and with its decoder opened so that switching to it is immediate */
+typedef struct AltStream {
+    int stream_index;
+    AVCodecContext *avctx;
+    PacketQueue q;
+} AltStream;
+
 typedef struct VideoState {
+    int instance;               /* position on the command line */
     SDL_Thread *read_tid;
+    AVIOContext *mapped_pb;
+    AVIOContext *read_ahead_pb;
+    int64_t demux_time;
+    int demux_count;
+    int64_t open_time;
+    int64_t first_frame_time;
     const AVInputFormat *iformat;
     int abort_request;
     int force_refresh;
+    int vis_due;                /* the audio visualization must advance on the next display */
     int paused;
     int last_paused;
     int queue_attachments_req;
@@ -214,6 +506,15 @@ typedef struct VideoState {
     int read_pause_return;
     AVFormatContext *ic;
     int realtime;
+    int live;
+    int64_t live_packets;
+    double live_transit;        /* arrival time minus timestamp of the last packet */
+    double live_offset;         /* smallest transit, arrival time of a timestamp without jitter */
+    double live_jitter;         /* interarrival jitter, as RTP computes it */
+    double live_delay;          /* depth of the jitter buffer */
+    double live_latency_sum, live_latency_max;
+    int live_latency_count;
+    int live_drops;
 
     Clock audclk;
     Clock vidclk;
@@ -256,11 +557,28 @@ typedef struct VideoState {
     struct SwrContext *swr_ctx;
     int frame_drops_early;
     int frame_drops_late;
+    int video_max_lowres;               /* how far the decoding resolution follows the tile, 0 not at all */
+    CatchUpLevel catch_up_base;         /* skipping asked for by the user */
+    DecodeLatency video_latency;
+    AltStream alt_streams[MAX_ALT_STREAMS];
+    int nb_alt_streams;
+    int switch_req;                 /* switching to the alternate stream switch_stream is asked for */
+    int switch_stream;
+    double audio_skip_until;        /* audio decoded after a switch that would have been played already */
+    int audio_skip_serial;
+    double pictq_cost_mean, pictq_cost_var;   /* of the time decoding a picture takes, in seconds */
+    int64_t pictq_shrink_since;
+    int pictq_depth_min, pictq_depth_max;
+    FramePool video_pool;
+    int catch_up_level;
+    int64_t catch_up_changed;
+    int64_t catch_up_time[CATCH_UP_LEVELS];
 
     enum ShowMode {
         SHOW_MODE_NONE = -1, SHOW_MODE_VIDEO = 0, SHOW_MODE_WAVES, SHOW_MODE_RDFT, SHOW_MODE_NB
     } show_mode;
-    int16_t sample_array[SAMPLE_ARRAY_SIZE];
+    int16_t *sample_array;          // only allocated while a visualization is displayed
+    int sample_array_size;
     int sample_array_index;
     int last_i_start;
     RDFTContext *rdft;
@@ -268,15 +586,23 @@ typedef struct VideoState {
     FFTSample *rdft_data;
     int xpos;
     double last_vis_time;
+    SDL_Rect *wave_rects;
+    unsigned int wave_rects_size;
+    int64_t waves_draw_time;
+    int waves_draw_count;
     SDL_Texture *vis_texture;
-    SDL_Texture *sub_texture;
     SDL_Texture *vid_texture;
+    SubAtlas sub_atlas;
 
     int subtitle_stream;
     AVStream *subtitle_st;
     PacketQueue subtitleq;
 
     double frame_timer;
+    double cadence_frac;            /* refresh intervals owed to or by the pictures already shown */
+    double cadence_delay;           /* time on screen of the last picture, in whole refresh intervals */
+    int cadence_known;              /* cadence_delay was computed when the last picture was picked */
+    int cadence_slots[CADENCE_MAX_SLOTS + 1];
     double frame_last_returned_time;
     double frame_last_filter_delay;
     int video_stream;
@@ -284,11 +610,20 @@ typedef struct VideoState {
     PacketQueue videoq;
     double max_frame_duration;      // maximum duration of a frame - above this, we consider the jump a timestamp discontinuity
     struct SwsContext *img_convert_ctx;
-    struct SwsContext *sub_convert_ctx;
     int eof;
 
     char *filename;
-    int width, height, xleft, ytop;
+    int width, height, xleft, ytop;     /* tile of the window the stream is shown in */
+    int seek_by_bytes;
+
+    SDL_AudioDeviceID audio_dev;
+    int64_t audio_callback_time;
+    struct AudioOutput *audio_out;      /* output of the device, shared along a playlist */
+    struct VideoState *preceding;       /* playlist item playing while this one pre-rolls */
+    struct VideoState *audio_successor; /* pre-rolled item waiting for the audio output */
+    int audio_handed_over;
+    int preroll_done;
+    int playlist_done;
     int step;
 
 #if CONFIG_AVFILTER
@@ -298,6 +633,8 @@ typedef struct VideoState {
     AVFilterContext *in_audio_filter;   // the first filter in the audio chain
     AVFilterContext *out_audio_filter;  // the last filter in the audio chain
     AVFilterGraph *agraph;              // audio filter graph
+    FilterGraphCache vgraph_cache;
+    FilterGraphCache agraph_cache;
 #endif
 
     int last_video_stream, last_audio_stream, last_subtitle_stream;
@@ -305,9 +642,55 @@ typedef struct VideoState {
     SDL_cond *continue_read_thread;
 } VideoState;
 
+static void alt_streams_close(VideoState *is);
+
+/* what an audio device plays, along a playlist the device goes from an item to the next */
+typedef struct AudioOutput {
+    VideoState *is;
+    int refcount;                       /* items holding the output, changed with the device locked */
+} AudioOutput;
+
+enum {
+    STARTUP_SDL,
+    STARTUP_RENDERER,
+    STARTUP_AUDIO_DEVICE,
+    STARTUP_OPEN_INPUT,
+    STARTUP_PROBE,
+    STARTUP_OPEN_STREAMS,
+    STARTUP_FIRST_OUTPUT,
+    STARTUP_NB
+};
+
+/* SDL, the renderer and the input are brought up at the same time, and the audio device once the input
+ * has told its parameters, each of them waiting for the others only where it needs them */
+typedef struct Startup {
+    SDL_mutex *mutex;
+    SDL_cond *cond;
+    int64_t origin;
+    int64_t start[STARTUP_NB], end[STARTUP_NB];
+    int printed;
+    SDL_Thread *audio_tid;
+    /* the output the first audio stream selected asks for, -1 once there is none */
+    int audio_wanted;
+    int64_t audio_wanted_layout;
+    int audio_wanted_channels, audio_wanted_rate;
+    /* the audio device opened for it while the decoders open, until the stream takes it */
+    AudioOutput *audio_out;
+    SDL_AudioDeviceID audio_dev;
+    struct AudioParams audio_tgt;
+    int audio_hw_buf_size;
+} Startup;
+
+static const char *const startup_phase_names[STARTUP_NB] = {
+    "SDL", "renderer", "audio device", "input open", "probing", "streams open", "first output",
+};
+
 /* options specified by the user */
 static const AVInputFormat *file_iformat;
 static const char *input_filename;
+static const char *input_filenames[MAX_INPUTS];
+static int nb_input_files;
+static int window_layout = LAYOUT_GRID;
 static const char *window_title;
 static int default_width  = 640;
 static int default_height = 480;
@@ -332,12 +715,21 @@ static int64_t duration = AV_NOPTS_VALUE;
 static int fast = 0;
 static int genpts = 0;
 static int lowres = 0;
+static int auto_lowres = 0;
+static int decode_policy = DECODE_POLICY_AUTO;
+static int frame_pool = 0;
+static int packet_arena = 0;
+static int adaptive_pictq = 0;
+static int prewarm = 0;
+static int pictq_budget = 256;
+static int huge_pages = 0;
 static int decoder_reorder_pts = -1;
 static int autoexit;
 static int exit_on_keydown;
 static int exit_on_mousedown;
 static int loop = 1;
 static int framedrop = -1;
+static int catch_up = 0;
 static int infinite_buffer = -1;
 static enum ShowMode show_mode = SHOW_MODE_NONE;
 static const char *audio_codec_name;
@@ -354,17 +746,41 @@ static char *afilters = NULL;
 static int autorotate = 1;
 static int find_stream_info = 1;
 static int filter_nbthreads = 0;
-
-/* current context */
+static int benchmark = 0;
+static int batch_waves = 1;
+static int mmap_input = 0;
+static int read_ahead_mb = 0;
+static int fast_start = 0;
+static const char *probe_cache_dir;
+static int live_mode = 0;
+
+/* current context, the window and the renderer are shared by all the playing instances */
 static int is_full_screen;
-static int64_t audio_callback_time;
+static VideoState *streams[MAX_INPUTS];
+static int nb_streams;
+static Startup startup;
+static int focused_stream;              /* the instance keys act on */
+static int display_pending;             /* an instance has a new picture to show */
+static int cadence;
+
+/* the refresh of the display, pictures are presented on its vsyncs */
+typedef struct VsyncClock {
+    double interval;                    /* 0 if unknown */
+    double last_present;                /* when the last present returned, on a vsync with PRESENTVSYNC */
+} VsyncClock;
+
+static VsyncClock vsync;
+static int playlist;
+static int playlist_index;
+static int playlist_next_index;
+static int playlist_ended;
+static VideoState *playlist_next;       /* item pre-rolled while the current one plays */
 
 #define FF_QUIT_EVENT    (SDL_USEREVENT + 2)
 
 static SDL_Window *window;
 static SDL_Renderer *renderer;
 static SDL_RendererInfo renderer_info = {0};
-static SDL_AudioDeviceID audio_dev;
 
 static const struct TextureFormatEntry {
     enum AVPixelFormat format;
@@ -421,7 +837,176 @@ int64_t get_valid_channel_layout(int64_t channel_layout, int channels)
         return 0;
 }
 
-static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
+static void startup_mark(int phase, int end)
+{
+    int64_t now = av_gettime_relative();
+
+    if (!startup.mutex)
+        return;
+    SDL_LockMutex(startup.mutex);
+    if (!startup.start[phase])
+        startup.start[phase] = now;
+    if (end && !startup.end[phase]) {
+        startup.end[phase] = now;
+        SDL_CondBroadcast(startup.cond);
+    }
+    SDL_UnlockMutex(startup.mutex);
+}
+
+/* wait until a phase is over, phases not run are over from the start */
+static void startup_wait(int phase)
+{
+    if (!startup.mutex)
+        return;
+    SDL_LockMutex(startup.mutex);
+    while (!startup.end[phase])
+        SDL_CondWait(startup.cond, startup.mutex);
+    SDL_UnlockMutex(startup.mutex);
+}
+
+/* print the startup timeline once, at the first picture or audio played */
+static void startup_print(void)
+{
+    int i;
+
+    if (!startup.mutex)
+        return;
+    startup_mark(STARTUP_FIRST_OUTPUT, 1);
+    SDL_LockMutex(startup.mutex);
+    if (!startup.printed && av_log_get_level() >= AV_LOG_VERBOSE) {
+        startup.start[STARTUP_FIRST_OUTPUT] = startup.origin;
+        for (i = 0; i < STARTUP_NB; i++)
+            if (startup.start[i])
+                av_log(NULL, AV_LOG_VERBOSE, "startup: %-13s %8.3f ms - %8.3f ms\n", startup_phase_names[i],
+                       (startup.start[i] - startup.origin) / 1000.0,
+                       startup.end[i] ? (startup.end[i] - startup.origin) / 1000.0 : NAN);
+    }
+    startup.printed = 1;
+    SDL_UnlockMutex(startup.mutex);
+}
+
+/* tell the audio_prepare thread the output of the first audio stream selected, none if nb_channels is 0 */
+static void audio_prepare_request(int64_t channel_layout, int nb_channels, int sample_rate)
+{
+    if (!startup.mutex)
+        return;
+    SDL_LockMutex(startup.mutex);
+    if (!startup.audio_wanted) {
+        startup.audio_wanted          = nb_channels > 0 && sample_rate > 0 ? 1 : -1;
+        startup.audio_wanted_layout   = channel_layout;
+        startup.audio_wanted_channels = nb_channels;
+        startup.audio_wanted_rate     = sample_rate;
+        SDL_CondBroadcast(startup.cond);
+    }
+    SDL_UnlockMutex(startup.mutex);
+}
+
+static void packet_arena_unref(PacketArena *arena)
+{
+    int refs;
+
+    SDL_LockMutex(arena->mutex);
+    refs = --arena->refs;
+    SDL_UnlockMutex(arena->mutex);
+    if (!refs) {
+        SDL_DestroyMutex(arena->mutex);
+        av_free(arena->data);
+        av_free(arena);
+    }
+}
+
+static PacketArena *packet_arena_alloc(int size)
+{
+    PacketArena *arena = av_mallocz(sizeof(*arena));
+
+    if (!arena)
+        return NULL;
+    arena->size = size;
+    arena->refs = 1;
+    if (!(arena->data = av_malloc(size)) || !(arena->mutex = SDL_CreateMutex())) {
+        av_free(arena->data);
+        av_free(arena);
+        return NULL;
+    }
+    return arena;
+}
+
+static void packet_arena_release(void *opaque, uint8_t *data)
+{
+    ArenaSlice *slice = opaque;
+    PacketArena *arena = slice->arena;
+
+    SDL_LockMutex(arena->mutex);
+    slice->released = 1;
+    while (arena->nb_slices && arena->slices[arena->first].released) {
+        slice = &arena->slices[arena->first];
+        arena->used -= slice->span;
+        arena->tail  = slice->end;
+        arena->first = (arena->first + 1) % PACKET_ARENA_SLICES;
+        arena->nb_slices--;
+    }
+    if (!arena->nb_slices)
+        arena->head = arena->tail = arena->used = 0;
+    SDL_UnlockMutex(arena->mutex);
+    packet_arena_unref(arena);
+}
+
+/* Move the payload of the packet into the arena, returns the memory it takes there or 0 if it does not fit. */
+static int packet_arena_move(PacketArena *arena, AVPacket *pkt)
+{
+    size_t size = FFALIGN((size_t)pkt->size + AV_INPUT_BUFFER_PADDING_SIZE, PACKET_ARENA_ALIGN);
+    size_t start, span = size;
+    ArenaSlice *slice;
+    AVBufferRef *buf;
+
+    SDL_LockMutex(arena->mutex);
+    if (arena->nb_slices == PACKET_ARENA_SLICES)
+        goto full;
+    if (!arena->nb_slices) {
+        if (size > arena->size)
+            goto full;
+        start = 0;
+    } else if (arena->head > arena->tail) {
+        /* free after the head up to the end and from the start up to the tail */
+        if (arena->head + size <= arena->size)
+            start = arena->head;
+        else if (size <= arena->tail)
+            start = 0, span += arena->size - arena->head;
+        else
+            goto full;
+    } else {
+        if (arena->head + size > arena->tail)
+            goto full;
+        start = arena->head;
+    }
+    slice = &arena->slices[(arena->first + arena->nb_slices) % PACKET_ARENA_SLICES];
+    slice->arena    = arena;
+    slice->span     = span;
+    slice->end      = (start + size) % arena->size;
+    slice->released = 0;
+    arena->head = slice->end;
+    arena->used += span;
+    arena->nb_slices++;
+    arena->refs++;
+    SDL_UnlockMutex(arena->mutex);
+
+    if (!(buf = av_buffer_create(arena->data + start, size, packet_arena_release, slice, 0))) {
+        packet_arena_release(slice, NULL);
+        return 0;
+    }
+    memcpy(buf->data, pkt->data, pkt->size);
+    memset(buf->data + pkt->size, 0, AV_INPUT_BUFFER_PADDING_SIZE);
+
+    av_buffer_unref(&pkt->buf);
+    pkt->buf  = buf;
+    pkt->data = buf->data;
+    return span;
+full:
+    SDL_UnlockMutex(arena->mutex);
+    return 0;
+}
+
+static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt, int mem)
 {
     MyAVPacketList pkt1;
 
@@ -435,10 +1020,11 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
 
     pkt1.pkt = pkt;
     pkt1.serial = q->serial;
+    pkt1.mem = mem + sizeof(pkt1) + sizeof(*pkt);
 
     av_fifo_generic_write(q->pkt_list, &pkt1, sizeof(pkt1), NULL);
     q->nb_packets++;
-    q->size += pkt1.pkt->size + sizeof(pkt1);
+    q->size += pkt1.mem;
     q->duration += pkt1.pkt->duration;
     /* XXX: should duplicate packet data in DV case */
     SDL_CondSignal(q->cond);
@@ -448,7 +1034,7 @@ static int packet_queue_put_private(PacketQueue *q, AVPacket *pkt)
 static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
 {
     AVPacket *pkt1;
-    int ret;
+    int mem = 0, ret;
 
     pkt1 = av_packet_alloc();
     if (!pkt1) {
@@ -457,8 +1043,20 @@ static int packet_queue_put(PacketQueue *q, AVPacket *pkt)
     }
     av_packet_move_ref(pkt1, pkt);
 
+    if (pkt1->size > 0 && q->arena_size) {
+        if (!q->arena && !(q->arena = packet_arena_alloc(q->arena_size)))
+            q->arena_size = 0;
+        if (q->arena && (mem = packet_arena_move(q->arena, pkt1)))
+            q->nb_arena_packets++;
+    }
+    if (!mem && pkt1->size > 0) {
+        /* the demuxer's own buffer, it can be shared and be larger than the payload */
+        mem = pkt1->buf ? pkt1->buf->size : pkt1->size;
+        q->nb_heap_packets++;
+    }
+
     SDL_LockMutex(q->mutex);
-    ret = packet_queue_put_private(q, pkt1);
+    ret = packet_queue_put_private(q, pkt1, mem);
     SDL_UnlockMutex(q->mutex);
 
     if (ret < 0)
@@ -514,6 +1112,10 @@ static void packet_queue_destroy(PacketQueue *q)
 {
     packet_queue_flush(q);
     av_fifo_freep(&q->pkt_list);
+    /* payloads still referenced by the decoders keep the arena alive */
+    if (q->arena)
+        packet_arena_unref(q->arena);
+    q->arena = NULL;
     SDL_DestroyMutex(q->mutex);
     SDL_DestroyCond(q->cond);
 }
@@ -554,7 +1156,7 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
         if (av_fifo_size(q->pkt_list) >= sizeof(pkt1)) {
             av_fifo_generic_read(q->pkt_list, &pkt1, sizeof(pkt1), NULL);
             q->nb_packets--;
-            q->size -= pkt1.pkt->size + sizeof(pkt1);
+            q->size -= pkt1.mem;
             q->duration -= pkt1.pkt->duration;
             av_packet_move_ref(pkt, pkt1.pkt);
             if (serial)
@@ -573,6 +1175,28 @@ static int packet_queue_get(PacketQueue *q, AVPacket *pkt, int block, int *seria
     return ret;
 }
 
+/* drop the oldest packets while there are more than max_packets or they end before min_ts */
+static void packet_queue_trim(PacketQueue *q, int max_packets, int64_t min_ts)
+{
+    MyAVPacketList pkt1;
+    int64_t ts;
+
+    SDL_LockMutex(q->mutex);
+    while (av_fifo_size(q->pkt_list) >= sizeof(pkt1)) {
+        av_fifo_generic_peek(q->pkt_list, &pkt1, sizeof(pkt1), NULL);
+        ts = pkt1.pkt->pts != AV_NOPTS_VALUE ? pkt1.pkt->pts : pkt1.pkt->dts;
+        if (q->nb_packets <= max_packets &&
+            (min_ts == AV_NOPTS_VALUE || ts == AV_NOPTS_VALUE || ts + pkt1.pkt->duration >= min_ts))
+            break;
+        av_fifo_drain(q->pkt_list, sizeof(pkt1));
+        q->nb_packets--;
+        q->size -= pkt1.mem;
+        q->duration -= pkt1.pkt->duration;
+        av_packet_free(&pkt1.pkt);
+    }
+    SDL_UnlockMutex(q->mutex);
+}
+
 static int decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue, SDL_cond *empty_queue_cond) {
     memset(d, 0, sizeof(Decoder));
     d->pkt = av_packet_alloc();
@@ -583,9 +1207,96 @@ static int decoder_init(Decoder *d, AVCodecContext *avctx, PacketQueue *queue, S
     d->empty_queue_cond = empty_queue_cond;
     d->start_pts = AV_NOPTS_VALUE;
     d->pkt_serial = -1;
+    d->wanted_lowres = avctx->lowres;
+    return 0;
+}
+
+/* replace the decoder by one decoding at another resolution, with the same settings */
+static int decoder_reopen(Decoder *d, int lowres)
+{
+    AVCodecContext *old = d->avctx, *avctx;
+    AVCodecParameters *par;
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (!(avctx = avcodec_alloc_context3(old->codec)))
+        return AVERROR(ENOMEM);
+    if (!(par = avcodec_parameters_alloc())) {
+        avcodec_free_context(&avctx);
+        return AVERROR(ENOMEM);
+    }
+    ret = avcodec_parameters_from_context(par, old);
+    if (ret >= 0) {
+        /* the context holds the reduced size, the decoder expects the coded one */
+        par->width  = old->coded_width  ? old->coded_width  : par->width;
+        par->height = old->coded_height ? old->coded_height : par->height;
+        ret = avcodec_parameters_to_context(avctx, par);
+    }
+    avcodec_parameters_free(&par);
+    if (ret < 0) {
+        avcodec_free_context(&avctx);
+        return ret;
+    }
+    avctx->pkt_timebase     = old->pkt_timebase;
+    avctx->flags            = old->flags;
+    avctx->flags2           = old->flags2;
+    avctx->thread_count     = old->thread_count;
+    avctx->thread_type      = old->thread_type;
+    avctx->skip_loop_filter = old->skip_loop_filter;
+    avctx->skip_idct        = old->skip_idct;
+    avctx->skip_frame       = old->skip_frame;
+    avctx->lowres           = lowres;
+    avctx->get_buffer2      = old->get_buffer2;
+    avctx->opaque           = old->opaque;
+    av_dict_set_int(&opts, "lowres", lowres, 0);
+    ret = avcodec_open2(avctx, old->codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0) {
+        avcodec_free_context(&avctx);
+        return ret;
+    }
+    avcodec_free_context(&d->retired_avctx);
+    d->retired_avctx = d->avctx;
+    d->avctx = avctx;
     return 0;
 }
 
+static void decode_latency_sent(DecodeLatency *l, const AVPacket *pkt)
+{
+    if (pkt->pts == AV_NOPTS_VALUE)
+        return;
+    l->pts[l->next]  = pkt->pts;
+    l->time[l->next] = av_gettime_relative();
+    l->next = (l->next + 1) % DECODE_LATENCY_SLOTS;
+}
+
+static void decode_latency_received(DecodeLatency *l, const AVFrame *frame)
+{
+    int i;
+
+    if (frame->pts == AV_NOPTS_VALUE)
+        return;
+    for (i = 0; i < DECODE_LATENCY_SLOTS; i++) {
+        if (l->pts[i] == frame->pts && l->time[i]) {
+            l->histogram[FFMIN((av_gettime_relative() - l->time[i]) / 1000, DECODE_LATENCY_MAX_MS)]++;
+            l->count++;
+            l->time[i] = 0;
+            return;
+        }
+    }
+}
+
+/* smallest latency in ms not exceeded by the given fraction of the pictures */
+static int decode_latency_percentile(const DecodeLatency *l, double fraction)
+{
+    int i, n = 0;
+
+    for (i = 0; i < DECODE_LATENCY_MAX_MS; i++)
+        if ((n += l->histogram[i]) >= fraction * l->count)
+            break;
+    return i;
+}
+
 static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
     int ret = AVERROR(EAGAIN);
 
@@ -599,6 +1310,8 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                     case AVMEDIA_TYPE_VIDEO:
                         ret = avcodec_receive_frame(d->avctx, frame);
                         if (ret >= 0) {
+                            if (d->latency)
+                                decode_latency_received(d->latency, frame);
                             if (decoder_reorder_pts == -1) {
                                 frame->pts = frame->best_effort_timestamp;
                             } else if (!decoder_reorder_pts) {
@@ -621,6 +1334,18 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                         }
                         break;
                 }
+                if (ret == AVERROR_EOF && d->reopening) {
+                    int wanted = d->wanted_lowres;
+                    d->reopening = 0;
+                    if ((ret = decoder_reopen(d, wanted)) < 0) {
+                        av_log(NULL, AV_LOG_WARNING, "Could not reopen the decoder at lowres %d\n", wanted);
+                        d->wanted_lowres = d->avctx->lowres;
+                        avcodec_flush_buffers(d->avctx);
+                    } else {
+                        av_log(NULL, AV_LOG_VERBOSE, "Decoding at lowres %d from now\n", wanted);
+                    }
+                    break;
+                }
                 if (ret == AVERROR_EOF) {
                     d->finished = d->pkt_serial;
                     avcodec_flush_buffers(d->avctx);
@@ -638,10 +1363,14 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
                 d->packet_pending = 0;
             } else {
                 int old_serial = d->pkt_serial;
+                int64_t wait_start = d->queue->nb_packets ? 0 : av_gettime_relative();
                 if (packet_queue_get(d->queue, d->pkt, 1, &d->pkt_serial) < 0)
                     return -1;
+                if (wait_start)
+                    d->packet_wait += av_gettime_relative() - wait_start;
                 if (old_serial != d->pkt_serial) {
                     avcodec_flush_buffers(d->avctx);
+                    d->reopening = 0;
                     d->finished = 0;
                     d->next_pts = d->start_pts;
                     d->next_pts_tb = d->start_pts_tb;
@@ -652,6 +1381,15 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
             av_packet_unref(d->pkt);
         } while (1);
 
+        if (d->avctx->codec_type == AVMEDIA_TYPE_VIDEO && d->wanted_lowres != d->avctx->lowres &&
+            d->pkt->data && (d->pkt->flags & AV_PKT_FLAG_KEY)) {
+            /* output the pictures still in the decoder, then reopen it before this key frame */
+            d->packet_pending = 1;
+            d->reopening = 1;
+            avcodec_send_packet(d->avctx, NULL);
+            continue;
+        }
+
         if (d->avctx->codec_type == AVMEDIA_TYPE_SUBTITLE) {
             int got_frame = 0;
             ret = avcodec_decode_subtitle2(d->avctx, sub, &got_frame, d->pkt);
@@ -665,6 +1403,8 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
             }
             av_packet_unref(d->pkt);
         } else {
+            if (d->latency && d->pkt->data)
+                decode_latency_sent(d->latency, d->pkt);
             if (avcodec_send_packet(d->avctx, d->pkt) == AVERROR(EAGAIN)) {
                 av_log(d->avctx, AV_LOG_ERROR, "Receive_frame and send_packet both returned EAGAIN, which is an API violation.\n");
                 d->packet_pending = 1;
@@ -678,12 +1418,24 @@ static int decoder_decode_frame(Decoder *d, AVFrame *frame, AVSubtitle *sub) {
 static void decoder_destroy(Decoder *d) {
     av_packet_free(&d->pkt);
     avcodec_free_context(&d->avctx);
+    avcodec_free_context(&d->retired_avctx);
+}
+
+static void free_subtitle_bitmaps(Frame *vp)
+{
+    int i;
+    for (i = 0; i < vp->nb_sub_bitmaps; i++)
+        av_freep(&vp->sub_bitmaps[i].pixels);
+    av_freep(&vp->sub_bitmaps);
+    vp->nb_sub_bitmaps = 0;
 }
 
 static void frame_queue_unref_item(Frame *vp)
 {
     av_frame_unref(vp->frame);
     avsubtitle_free(&vp->sub);
+    free_subtitle_bitmaps(vp);
+    av_freep(&vp->sub_rects);
 }
 
 static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int keep_last)
@@ -700,6 +1452,7 @@ static int frame_queue_init(FrameQueue *f, PacketQueue *pktq, int max_size, int
     }
     f->pktq = pktq;
     f->max_size = FFMIN(max_size, FRAME_QUEUE_SIZE);
+    f->depth = f->max_size;
     f->keep_last = !!keep_last;
     for (i = 0; i < f->max_size; i++)
         if (!(f->queue[i].frame = av_frame_alloc()))
@@ -745,7 +1498,7 @@ static Frame *frame_queue_peek_writable(FrameQueue *f)
 {
     /* wait until we have space to put a new frame */
     SDL_LockMutex(f->mutex);
-    while (f->size >= f->max_size &&
+    while (f->size >= f->depth &&
            !f->pktq->abort_request) {
         SDL_CondWait(f->cond, f->mutex);
     }
@@ -823,15 +1576,30 @@ static void decoder_abort(Decoder *d, FrameQueue *fq)
     packet_queue_flush(d->queue);
 }
 
-static inline void fill_rectangle(int x, int y, int w, int h)
+/* append a rectangle to a batch which is later drawn by fill_rectangles() */
+static inline void add_rectangle(SDL_Rect *rects, int *nb_rects, int x, int y, int w, int h)
 {
-    SDL_Rect rect;
-    rect.x = x;
-    rect.y = y;
-    rect.w = w;
-    rect.h = h;
-    if (w && h)
-        SDL_RenderFillRect(renderer, &rect);
+    SDL_Rect *rect;
+    if (w && h) {
+        rect = &rects[(*nb_rects)++];
+        rect->x = x;
+        rect->y = y;
+        rect->w = w;
+        rect->h = h;
+    }
+}
+
+/* draw a batch in one call, or one call per rectangle as before batching to compare with -benchmark */
+static void fill_rectangles(const SDL_Rect *rects, int nb_rects)
+{
+    int i;
+
+    if (batch_waves) {
+        SDL_RenderFillRects(renderer, rects, nb_rects);
+        return;
+    }
+    for (i = 0; i < nb_rects; i++)
+        SDL_RenderFillRect(renderer, &rects[i]);
 }
 
 static int realloc_texture(SDL_Texture **texture, Uint32 new_format, int new_width, int new_height, SDL_BlendMode blendmode, int init_texture)
@@ -970,6 +1738,166 @@ static void set_sdl_yuv_conversion_mode(AVFrame *frame)
 #endif
 }
 
+static void sub_atlas_reset(SubAtlas *a)
+{
+    a->shelf_x = a->shelf_y = a->shelf_h = 0;
+    a->nb_entries = 0;
+    a->generation++;
+}
+
+static void sub_atlas_destroy(SubAtlas *a)
+{
+    if (a->texture)
+        SDL_DestroyTexture(a->texture);
+    a->texture = NULL;
+    sub_atlas_reset(a);
+}
+
+static uint64_t sub_rect_hash(const AVSubtitleRect *r)
+{
+    /* 64 bit FNV-1a over the geometry, the visible pixels and the used palette entries */
+    uint64_t h = 0xcbf29ce484222325ULL;
+    const uint8_t *src = r->data[0];
+    int x, y;
+
+#define HASH_BYTE(b) h = (h ^ (b)) * 0x100000001b3ULL
+    HASH_BYTE(r->w & 0xff); HASH_BYTE(r->w >> 8);
+    HASH_BYTE(r->h & 0xff); HASH_BYTE(r->h >> 8);
+    for (y = 0; y < r->h; y++, src += r->linesize[0])
+        for (x = 0; x < r->w; x++)
+            HASH_BYTE(src[x]);
+    for (x = 0; x < r->nb_colors * 4; x++)
+        HASH_BYTE(r->data[1][x]);
+#undef HASH_BYTE
+    return h;
+}
+
+/* the PAL8 palette holds native endian ARGB entries, which is the SDL_PIXELFORMAT_ARGB8888 layout */
+static void expand_pal8(uint8_t *dst, int dst_pitch, const AVSubtitleRect *r)
+{
+    const uint32_t *pal = (const uint32_t *)r->data[1];
+    const uint8_t *src = r->data[0];
+    int x, y;
+
+    for (y = 0; y < r->h; y++) {
+        uint32_t *d = (uint32_t *)dst;
+        for (x = 0; x < r->w; x++)
+            d[x] = pal[src[x]];
+        src += r->linesize[0];
+        dst += dst_pitch;
+    }
+}
+
+/* convert the bitmaps of a subtitle, called by the subtitle thread so the display only has to upload them */
+static int prepare_subtitle_bitmaps(Frame *sp)
+{
+    int i;
+
+    if (!(sp->sub_bitmaps = av_calloc(FFMAX(sp->sub.num_rects, 1), sizeof(*sp->sub_bitmaps))))
+        return AVERROR(ENOMEM);
+    sp->nb_sub_bitmaps = sp->sub.num_rects;
+    for (i = 0; i < sp->sub.num_rects; i++) {
+        AVSubtitleRect *sub_rect = sp->sub.rects[i];
+        SubBitmap *bmp = &sp->sub_bitmaps[i];
+
+        if (sub_rect->w <= 0 || sub_rect->h <= 0 || !sub_rect->data[0] || !sub_rect->data[1])
+            continue;
+        if (!(bmp->pixels = av_malloc_array(sub_rect->h, sub_rect->w * 4))) {
+            free_subtitle_bitmaps(sp);
+            return AVERROR(ENOMEM);
+        }
+        bmp->pitch = sub_rect->w * 4;
+        bmp->key = sub_rect_hash(sub_rect);
+        expand_pal8(bmp->pixels, bmp->pitch, sub_rect);
+    }
+    return 0;
+}
+
+static SubAtlasEntry *sub_atlas_alloc(SubAtlas *a, int w, int h)
+{
+    SubAtlasEntry *entry;
+
+    if (a->nb_entries >= SUB_ATLAS_MAX_ENTRIES)
+        return NULL;
+    if (a->shelf_x + w > a->width) {
+        a->shelf_y += a->shelf_h;
+        a->shelf_x = 0;
+        a->shelf_h = 0;
+    }
+    if (w > a->width || a->shelf_y + h > a->height)
+        return NULL;
+    entry = &a->entries[a->nb_entries++];
+    entry->w = entry->rect.w = w;
+    entry->h = entry->rect.h = h;
+    entry->rect.x = a->shelf_x;
+    entry->rect.y = a->shelf_y;
+    a->shelf_x += w;
+    a->shelf_h = FFMAX(a->shelf_h, h);
+    return entry;
+}
+
+/* find the atlas location of each bitmap of the subtitle, uploading only the ones not present yet */
+static int upload_subtitle(SubAtlas *a, Frame *sp)
+{
+    int width = FFMAX(SUB_ATLAS_SIZE, sp->width);
+    int height = FFMAX(SUB_ATLAS_SIZE, sp->height);
+    int restarted = 0, i, j;
+
+    if (!a->texture || a->width != width || a->height != height) {
+        if (realloc_texture(&a->texture, SDL_PIXELFORMAT_ARGB8888, width, height, SDL_BLENDMODE_BLEND, 0) < 0)
+            return -1;
+        a->width = width;
+        a->height = height;
+        sub_atlas_reset(a);
+    }
+    if (!sp->sub_bitmaps && prepare_subtitle_bitmaps(sp) < 0)
+        return AVERROR(ENOMEM);
+    av_freep(&sp->sub_rects);
+    if (!(sp->sub_rects = av_calloc(FFMAX(sp->sub.num_rects, 1), sizeof(*sp->sub_rects))))
+        return AVERROR(ENOMEM);
+
+retry:
+    for (i = 0; i < sp->sub.num_rects; i++) {
+        AVSubtitleRect *sub_rect = sp->sub.rects[i];
+        SubBitmap *bmp = &sp->sub_bitmaps[i];
+        SubAtlasEntry *entry = NULL;
+
+        sub_rect->x = av_clip(sub_rect->x, 0, sp->width );
+        sub_rect->y = av_clip(sub_rect->y, 0, sp->height);
+        sub_rect->w = av_clip(sub_rect->w, 0, sp->width  - sub_rect->x);
+        sub_rect->h = av_clip(sub_rect->h, 0, sp->height - sub_rect->y);
+        memset(&sp->sub_rects[i], 0, sizeof(sp->sub_rects[i]));
+        if (!sub_rect->w || !sub_rect->h || !bmp->pixels)
+            continue;
+
+        for (j = 0; j < a->nb_entries; j++) {
+            if (a->entries[j].key == bmp->key && a->entries[j].w == sub_rect->w && a->entries[j].h == sub_rect->h) {
+                entry = &a->entries[j];
+                a->hits++;
+                break;
+            }
+        }
+        if (!entry) {
+            if (!(entry = sub_atlas_alloc(a, sub_rect->w, sub_rect->h))) {
+                /* start over on an empty atlas unless this subtitle alone does not fit */
+                if (!restarted) {
+                    restarted = 1;
+                    sub_atlas_reset(a);
+                    goto retry;
+                }
+                av_log(NULL, AV_LOG_WARNING, "Subtitle bitmaps do not fit into the %dx%d atlas\n", a->width, a->height);
+                continue;
+            }
+            entry->key = bmp->key;
+            a->uploads++;
+            SDL_UpdateTexture(a->texture, &entry->rect, bmp->pixels, bmp->pitch);
+        }
+        sp->sub_rects[i] = entry->rect;
+    }
+    sp->sub_atlas_generation = a->generation;
+    return 0;
+}
+
 static void video_image_display(VideoState *is)
 {
     Frame *vp;
@@ -981,43 +1909,17 @@ static void video_image_display(VideoState *is)
         if (frame_queue_nb_remaining(&is->subpq) > 0) {
             sp = frame_queue_peek(&is->subpq);
 
-            if (vp->pts >= sp->pts + ((float) sp->sub.start_display_time / 1000)) {
-                if (!sp->uploaded) {
-                    uint8_t* pixels[4];
-                    int pitch[4];
-                    int i;
-                    if (!sp->width || !sp->height) {
-                        sp->width = vp->width;
-                        sp->height = vp->height;
-                    }
-                    if (realloc_texture(&is->sub_texture, SDL_PIXELFORMAT_ARGB8888, sp->width, sp->height, SDL_BLENDMODE_BLEND, 1) < 0)
-                        return;
-
-                    for (i = 0; i < sp->sub.num_rects; i++) {
-                        AVSubtitleRect *sub_rect = sp->sub.rects[i];
-
-                        sub_rect->x = av_clip(sub_rect->x, 0, sp->width );
-                        sub_rect->y = av_clip(sub_rect->y, 0, sp->height);
-                        sub_rect->w = av_clip(sub_rect->w, 0, sp->width  - sub_rect->x);
-                        sub_rect->h = av_clip(sub_rect->h, 0, sp->height - sub_rect->y);
-
-                        is->sub_convert_ctx = sws_getCachedContext(is->sub_convert_ctx,
-                            sub_rect->w, sub_rect->h, AV_PIX_FMT_PAL8,
-                            sub_rect->w, sub_rect->h, AV_PIX_FMT_BGRA,
-                            0, NULL, NULL, NULL);
-                        if (!is->sub_convert_ctx) {
-                            av_log(NULL, AV_LOG_FATAL, "Cannot initialize the conversion context\n");
-                            return;
-                        }
-                        if (!SDL_LockTexture(is->sub_texture, (SDL_Rect *)sub_rect, (void **)pixels, pitch)) {
-                            sws_scale(is->sub_convert_ctx, (const uint8_t * const *)sub_rect->data, sub_rect->linesize,
-                                      0, sub_rect->h, pixels, pitch);
-                            SDL_UnlockTexture(is->sub_texture);
-                        }
-                    }
-                    sp->uploaded = 1;
+            /* upload the next subtitle already before its start time, so showing it costs nothing */
+            if (!sp->uploaded || sp->sub_atlas_generation != is->sub_atlas.generation) {
+                if (!sp->width || !sp->height) {
+                    sp->width = vp->width;
+                    sp->height = vp->height;
                 }
-            } else
+                if (upload_subtitle(&is->sub_atlas, sp) < 0)
+                    return;
+                sp->uploaded = 1;
+            }
+            if (!(vp->pts >= sp->pts + ((float) sp->sub.start_display_time / 1000)))
                 sp = NULL;
         }
     }
@@ -1034,10 +1936,14 @@ static void video_image_display(VideoState *is)
     set_sdl_yuv_conversion_mode(vp->frame);
     SDL_RenderCopyEx(renderer, is->vid_texture, NULL, &rect, 0, NULL, vp->flip_v ? SDL_FLIP_VERTICAL : 0);
     set_sdl_yuv_conversion_mode(NULL);
+
+    if (!is->first_frame_time) {
+        is->first_frame_time = av_gettime_relative();
+        av_log(NULL, AV_LOG_VERBOSE, "First frame shown %0.3f ms after opening\n",
+               (is->first_frame_time - is->open_time) / 1000.0);
+        startup_print();
+    }
     if (sp) {
-#if USE_ONEPASS_SUBTITLE_RENDER
-        SDL_RenderCopy(renderer, is->sub_texture, NULL, &rect);
-#else
         int i;
         double xratio = (double)rect.w / (double)sp->width;
         double yratio = (double)rect.h / (double)sp->height;
@@ -1047,9 +1953,9 @@ static void video_image_display(VideoState *is)
                                .y = rect.y + sub_rect->y * yratio,
                                .w = sub_rect->w * xratio,
                                .h = sub_rect->h * yratio};
-            SDL_RenderCopy(renderer, is->sub_texture, sub_rect, &target);
+            if (sp->sub_rects[i].w && sp->sub_rects[i].h)
+                SDL_RenderCopy(renderer, is->sub_atlas.texture, &sp->sub_rects[i], &target);
         }
-#endif
     }
 }
 
@@ -1058,30 +1964,84 @@ static inline int compute_mod(int a, int b)
     return a < 0 ? a%b + b : a%b;
 }
 
+/* the display looks back by the unplayed part of the current audio buffer plus twice the
+   displayed window, keep headroom for the zero crossing search and bigger audio frames */
+static int sample_array_wanted_size(VideoState *s, int nb_freq)
+{
+    int64_t window = FFMAX(FFMAX(s->width, (int)(rdftspeed * s->audio_tgt.freq)), 2 * nb_freq);
+    int64_t size = 2 * (FFMAX(s->audio_buf_size, s->audio_hw_buf_size) / sizeof(int16_t) +
+                        2 * window * s->audio_tgt.channels) + 1024;
+    return FFMIN(size, SAMPLE_ARRAY_SIZE);
+}
+
+static void sample_array_free(VideoState *s)
+{
+    int16_t *sample_array;
+
+    /* the audio callback writes to the array with the device lock held */
+    SDL_LockAudioDevice(s->audio_dev);
+    sample_array = s->sample_array;
+    s->sample_array = NULL;
+    s->sample_array_size = 0;
+    s->sample_array_index = 0;
+    SDL_UnlockAudioDevice(s->audio_dev);
+    av_free(sample_array);
+}
+
+static int sample_array_realloc(VideoState *s, int size)
+{
+    int16_t *sample_array, *old_sample_array;
+
+    if (!(sample_array = av_calloc(size, sizeof(*sample_array))))
+        return AVERROR(ENOMEM);
+    SDL_LockAudioDevice(s->audio_dev);
+    old_sample_array = s->sample_array;
+    s->sample_array = sample_array;
+    s->sample_array_size = size;
+    s->sample_array_index = 0;
+    s->last_i_start = 0;
+    SDL_UnlockAudioDevice(s->audio_dev);
+    av_free(old_sample_array);
+    av_log(NULL, AV_LOG_VERBOSE, "Allocated %d samples for audio visualization.\n", size);
+    return 0;
+}
+
 static void video_audio_display(VideoState *s)
 {
-    int i, i_start, x, y1, y, ys, delay, n, nb_display_channels;
+    int i, i_start, x, y1, y, delay, n, nb_display_channels;
     int ch, channels, h, h2;
     int64_t time_diff;
-    int rdft_bits, nb_freq;
+    int rdft_bits, nb_freq, data_used, wanted_size;
 
     for (rdft_bits = 1; (1 << rdft_bits) < 2 * s->height; rdft_bits++)
         ;
     nb_freq = 1 << (rdft_bits - 1);
 
+    /* the sample buffer is only fed once it exists, so the first frames show silence */
+    wanted_size = sample_array_wanted_size(s, nb_freq);
+    if (s->sample_array_size < wanted_size && sample_array_realloc(s, wanted_size) < 0)
+        return;
+
     /* compute display index : center on currently output samples */
     channels = s->audio_tgt.channels;
     nb_display_channels = channels;
+    /* the waves display covers at least one refresh period so no samples are skipped between redraws,
+       several samples per column are then decimated to their min/max */
+    if (s->show_mode == SHOW_MODE_WAVES) {
+        data_used = FFMAX(s->width, (int)(rdftspeed * s->audio_tgt.freq));
+        /* the look back is twice the window, it must stay within the array capped at SAMPLE_ARRAY_SIZE */
+        data_used = FFMIN(data_used, s->sample_array_size / (2 * channels));
+    } else
+        data_used = 2 * nb_freq;
     if (!s->paused) {
-        int data_used= s->show_mode == SHOW_MODE_WAVES ? s->width : (2*nb_freq);
         n = 2 * channels;
         delay = s->audio_write_buf_size;
         delay /= n;
 
         /* to be more precise, we take into account the time spent since
            the last buffer computation */
-        if (audio_callback_time) {
-            time_diff = av_gettime_relative() - audio_callback_time;
+        if (s->audio_callback_time) {
+            time_diff = av_gettime_relative() - s->audio_callback_time;
             delay -= (time_diff * s->audio_tgt.freq) / 1000000;
         }
 
@@ -1089,15 +2049,15 @@ static void video_audio_display(VideoState *s)
         if (delay < data_used)
             delay = data_used;
 
-        i_start= x = compute_mod(s->sample_array_index - delay * channels, SAMPLE_ARRAY_SIZE);
+        i_start= x = compute_mod(s->sample_array_index - delay * channels, s->sample_array_size);
         if (s->show_mode == SHOW_MODE_WAVES) {
             h = INT_MIN;
             for (i = 0; i < 1000; i += channels) {
-                int idx = (SAMPLE_ARRAY_SIZE + x - i) % SAMPLE_ARRAY_SIZE;
+                int idx = (s->sample_array_size + x - i) % s->sample_array_size;
                 int a = s->sample_array[idx];
-                int b = s->sample_array[(idx + 4 * channels) % SAMPLE_ARRAY_SIZE];
-                int c = s->sample_array[(idx + 5 * channels) % SAMPLE_ARRAY_SIZE];
-                int d = s->sample_array[(idx + 9 * channels) % SAMPLE_ARRAY_SIZE];
+                int b = s->sample_array[(idx + 4 * channels) % s->sample_array_size];
+                int c = s->sample_array[(idx + 5 * channels) % s->sample_array_size];
+                int d = s->sample_array[(idx + 9 * channels) % s->sample_array_size];
                 int score = a - d;
                 if (h < score && (b ^ c) < 0) {
                     h = score;
@@ -1112,7 +2072,14 @@ static void video_audio_display(VideoState *s)
     }
 
     if (s->show_mode == SHOW_MODE_WAVES) {
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        int64_t draw_start = av_gettime_relative();
+        int nb_rects = 0;
+        int j, nb_samples, smin, smax, ymin, ymax;
+
+        /* one rectangle per column and channel, reused afterwards for the channel separators */
+        av_fast_malloc(&s->wave_rects, &s->wave_rects_size, (size_t)(s->width + 1) * nb_display_channels * sizeof(*s->wave_rects));
+        if (!s->wave_rects)
+            return;
 
         /* total height for one channel */
         h = s->height / nb_display_channels;
@@ -1122,26 +2089,36 @@ static void video_audio_display(VideoState *s)
             i = i_start + ch;
             y1 = s->ytop + ch * h + (h / 2); /* position of center line */
             for (x = 0; x < s->width; x++) {
-                y = (s->sample_array[i] * h2) >> 15;
-                if (y < 0) {
-                    y = -y;
-                    ys = y1 - y;
-                } else {
-                    ys = y1;
+                /* the column spans from the center line to the extreme samples mapped on it */
+                nb_samples = (int)((int64_t)(x + 1) * data_used / s->width - (int64_t)x * data_used / s->width);
+                smin = smax = 0;
+                for (j = 0; j < nb_samples; j++) {
+                    smin = FFMIN(smin, s->sample_array[i]);
+                    smax = FFMAX(smax, s->sample_array[i]);
+                    i += channels;
+                    if (i >= s->sample_array_size)
+                        i -= s->sample_array_size;
                 }
-                fill_rectangle(s->xleft + x, ys, 1, y);
-                i += channels;
-                if (i >= SAMPLE_ARRAY_SIZE)
-                    i -= SAMPLE_ARRAY_SIZE;
+                ymin = (smin * h2) >> 15;
+                ymax = (smax * h2) >> 15;
+                add_rectangle(s->wave_rects, &nb_rects, s->xleft + x, y1 + ymin, 1, ymax - ymin);
             }
         }
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        fill_rectangles(s->wave_rects, nb_rects);
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
-
+        nb_rects = 0;
         for (ch = 1; ch < nb_display_channels; ch++) {
             y = s->ytop + ch * h;
-            fill_rectangle(s->xleft, y, s->width, 1);
+            add_rectangle(s->wave_rects, &nb_rects, s->xleft, y, s->width, 1);
         }
+        if (nb_rects) {
+            SDL_SetRenderDrawColor(renderer, 0, 0, 255, 255);
+            fill_rectangles(s->wave_rects, nb_rects);
+        }
+
+        s->waves_draw_time += av_gettime_relative() - draw_start;
+        s->waves_draw_count++;
     } else {
         if (realloc_texture(&s->vis_texture, SDL_PIXELFORMAT_ARGB8888, s->width, s->height, SDL_BLENDMODE_NONE, 1) < 0)
             return;
@@ -1159,9 +2136,15 @@ static void video_audio_display(VideoState *s)
         if (!s->rdft || !s->rdft_data){
             av_log(NULL, AV_LOG_ERROR, "Failed to allocate buffers for RDFT, switching to waves display\n");
             s->show_mode = SHOW_MODE_WAVES;
+        } else if (!s->vis_due) {
+            /* another tile of the window is being refreshed, show the spectrum as it is */
+            SDL_Rect tile = { s->xleft, s->ytop, s->width, s->height };
+            SDL_RenderCopy(renderer, s->vis_texture, NULL, &tile);
+            return;
         } else {
             FFTSample *data[2];
             SDL_Rect rect = {.x = s->xpos, .y = 0, .w = 1, .h = s->height};
+            SDL_Rect tile = { s->xleft, s->ytop, s->width, s->height };
             uint32_t *pixels;
             int pitch;
             for (ch = 0; ch < nb_display_channels; ch++) {
@@ -1171,8 +2154,8 @@ static void video_audio_display(VideoState *s)
                     double w = (x-nb_freq) * (1.0 / nb_freq);
                     data[ch][x] = s->sample_array[i] * (1.0 - w * w);
                     i += channels;
-                    if (i >= SAMPLE_ARRAY_SIZE)
-                        i -= SAMPLE_ARRAY_SIZE;
+                    if (i >= s->sample_array_size)
+                        i -= s->sample_array_size;
                 }
                 av_rdft_calc(s->rdft, data[ch]);
             }
@@ -1193,13 +2176,50 @@ static void video_audio_display(VideoState *s)
                 }
                 SDL_UnlockTexture(s->vis_texture);
             }
-            SDL_RenderCopy(renderer, s->vis_texture, NULL, NULL);
+            SDL_RenderCopy(renderer, s->vis_texture, NULL, &tile);
         }
         if (!s->paused)
             s->xpos++;
     }
 }
 
+/* detach an instance from its audio output, the device is closed once no playlist item holds the
+ * output anymore */
+static void audio_output_release(VideoState *is)
+{
+    AudioOutput *out = is->audio_out;
+    VideoState *next = NULL;
+    int last;
+
+    if (!out)
+        return;
+    SDL_LockAudioDevice(is->audio_dev);
+    if (is->preceding && is->preceding->audio_successor == is)
+        is->preceding->audio_successor = NULL;
+    if (out->is == is) {
+        if (is->audio_successor)
+            next = is->audio_successor;
+        else if (is->preceding && is->preceding->audio_out == out)
+            /* a pre-rolled item closed after it got the output gives it back to the item playing */
+            out->is = is->preceding;
+    }
+    last = !--out->refcount;
+    SDL_UnlockAudioDevice(is->audio_dev);
+
+    if (next) {
+        /* the pre-rolled item keeps the output, silent until it starts playing */
+        SDL_PauseAudioDevice(is->audio_dev, 1);
+        SDL_LockAudioDevice(is->audio_dev);
+        out->is = next;
+        is->audio_successor = NULL;
+        SDL_UnlockAudioDevice(is->audio_dev);
+    } else if (last) {
+        SDL_CloseAudioDevice(is->audio_dev);
+        av_free(out);
+    }
+    is->audio_out = NULL;
+}
+
 static void stream_component_close(VideoState *is, int stream_index)
 {
     AVFormatContext *ic = is->ic;
@@ -1212,12 +2232,15 @@ static void stream_component_close(VideoState *is, int stream_index)
     switch (codecpar->codec_type) {
     case AVMEDIA_TYPE_AUDIO:
         decoder_abort(&is->auddec, &is->sampq);
-        SDL_CloseAudioDevice(audio_dev);
+        audio_output_release(is);
         decoder_destroy(&is->auddec);
         swr_free(&is->swr_ctx);
         av_freep(&is->audio_buf1);
         is->audio_buf1_size = 0;
         is->audio_buf = NULL;
+        av_freep(&is->sample_array);
+        is->sample_array_size = 0;
+        is->sample_array_index = 0;
 
         if (is->rdft) {
             av_rdft_end(is->rdft);
@@ -1229,6 +2252,7 @@ static void stream_component_close(VideoState *is, int stream_index)
     case AVMEDIA_TYPE_VIDEO:
         decoder_abort(&is->viddec, &is->pictq);
         decoder_destroy(&is->viddec);
+        frame_pool_uninit(&is->video_pool);
         break;
     case AVMEDIA_TYPE_SUBTITLE:
         decoder_abort(&is->subdec, &is->subpq);
@@ -1257,12 +2281,467 @@ static void stream_component_close(VideoState *is, int stream_index)
     }
 }
 
+/* Keep the pages from the read position up to MAPPED_FILE_READ_AHEAD bytes on coming in, renewing the
+ * window once half of it is consumed or when a seek leaves it. Windows has no madvise(), the cache
+ * manager read-ahead of the FILE_FLAG_SEQUENTIAL_SCAN handle does the same there. */
+static void mapped_file_read_ahead(MappedFile *mf)
+{
+#if HAVE_MMAP
+    int64_t start, end;
+
+    if (mf->pos >= mf->ahead_start && mf->pos + MAPPED_FILE_READ_AHEAD / 2 <= mf->ahead_end)
+        return;
+    start = mf->pos & ~(int64_t)(mf->page_size - 1);
+    end   = FFMIN(start + MAPPED_FILE_READ_AHEAD, mf->size);
+    if (start < end)
+        madvise((void *)(mf->data + start), end - start, MADV_WILLNEED);
+    mf->ahead_start = start;
+    mf->ahead_end   = end;
+#endif
+}
+
+static int mapped_file_read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+    MappedFile *mf = opaque;
+
+    if (mf->pos >= mf->size)
+        return AVERROR_EOF;
+    buf_size = FFMIN(buf_size, mf->size - mf->pos);
+    mapped_file_read_ahead(mf);
+    memcpy(buf, mf->data + mf->pos, buf_size);
+    mf->pos += buf_size;
+    return buf_size;
+}
+
+static int64_t mapped_file_seek(void *opaque, int64_t offset, int whence)
+{
+    MappedFile *mf = opaque;
+    int64_t pos;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return mf->size;
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = mf->pos + offset;
+        break;
+    case SEEK_END:
+        pos = mf->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+    mf->pos = pos;
+    return pos;
+}
+
+static void mapped_file_unmap(MappedFile *mf)
+{
+#if HAVE_MMAP
+    munmap((void *)mf->data, mf->size);
+#elif HAVE_MAPVIEWOFFILE
+    UnmapViewOfFile(mf->data);
+    CloseHandle(mf->mapping);
+#endif
+}
+
+static int mapped_file_map(MappedFile *mf, const char *path)
+{
+#if HAVE_MMAP
+    struct stat st;
+    void *data;
+    int fd = open(path, O_RDONLY);
+
+    if (fd < 0)
+        return AVERROR(errno);
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || !st.st_size || st.st_size > SIZE_MAX) {
+        close(fd);
+        return AVERROR(ENOTSUP);
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return AVERROR(errno);
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    mf->data      = data;
+    mf->size      = st.st_size;
+    mf->page_size = sysconf(_SC_PAGESIZE);
+    return 0;
+#elif HAVE_MAPVIEWOFFILE
+    wchar_t *wpath;
+    HANDLE file;
+    LARGE_INTEGER size;
+    int len = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, path, -1, NULL, 0);
+
+    if (len <= 0 || !(wpath = av_malloc_array(len, sizeof(*wpath))))
+        return AVERROR(ENOMEM);
+    MultiByteToWideChar(CP_UTF8, 0, path, -1, wpath, len);
+    file = CreateFileW(wpath, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    av_free(wpath);
+    if (file == INVALID_HANDLE_VALUE)
+        return AVERROR(ENOENT);
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &size) ||
+        !size.QuadPart || size.QuadPart > SIZE_MAX) {
+        CloseHandle(file);
+        return AVERROR(ENOTSUP);
+    }
+    mf->mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+    if (!mf->mapping)
+        return AVERROR(ENOMEM);
+    if (!(mf->data = MapViewOfFile(mf->mapping, FILE_MAP_READ, 0, 0, 0))) {
+        CloseHandle(mf->mapping);
+        return AVERROR(ENOMEM);
+    }
+    mf->size = size.QuadPart;
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
+/* Map a local file and wrap it in an AVIOContext, so demuxing it needs no read() syscall. The
+ * context is in direct mode: large reads are copied from the mapping right into the packets. */
+static int mapped_file_open(AVIOContext **pb, const char *filename)
+{
+    MappedFile *mf;
+    uint8_t *buffer;
+    const char *protocol = avio_find_protocol_name(filename);
+    int ret;
+
+    if (!protocol || strcmp(protocol, "file"))
+        return AVERROR(ENOTSUP);
+    av_strstart(filename, "file:", &filename);
+
+    if (!(mf = av_mallocz(sizeof(*mf))))
+        return AVERROR(ENOMEM);
+    if ((ret = mapped_file_map(mf, filename)) < 0) {
+        av_free(mf);
+        return ret;
+    }
+    if (!(buffer = av_malloc(INPUT_IO_BUFFER_SIZE)) ||
+        !(*pb = avio_alloc_context(buffer, INPUT_IO_BUFFER_SIZE, 0, mf,
+                                   mapped_file_read_packet, NULL, mapped_file_seek))) {
+        av_free(buffer);
+        mapped_file_unmap(mf);
+        av_free(mf);
+        return AVERROR(ENOMEM);
+    }
+    (*pb)->direct = 1;
+    return 0;
+}
+
+static void mapped_file_close(AVIOContext **pb)
+{
+    if (!*pb)
+        return;
+    mapped_file_unmap((*pb)->opaque);
+    av_freep(&(*pb)->opaque);
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
+
+static int read_ahead_thread(void *arg)
+{
+    ReadAhead *ra = arg;
+    ReadAheadBlock *block;
+    int64_t pos;
+    int ret;
+
+    SDL_LockMutex(ra->mutex);
+    while (!ra->abort_request) {
+        if (ra->seek_pos >= 0) {
+            /* the blocks restart from pos while the seek is in flight, so that the demuxer
+             * waits for it instead of asking for the same seek again */
+            pos = ra->seek_pos;
+            ra->seek_pos = -1;
+            ra->fill_pos = pos;
+            ra->eof      = 0;
+            ra->error    = 0;
+            SDL_UnlockMutex(ra->mutex);
+            ret = avio_seek(ra->src, pos, SEEK_SET);
+            SDL_LockMutex(ra->mutex);
+            if (ra->seek_pos >= 0)
+                continue;
+            ra->error = ret < 0 ? ret : 0;
+            SDL_CondSignal(ra->cond);
+            continue;
+        }
+        if (ra->nb_filled == ra->nb_blocks || ra->eof || ra->error) {
+            SDL_CondWait(ra->cond, ra->mutex);
+            continue;
+        }
+        block = &ra->blocks[(ra->rindex + ra->nb_filled) % ra->nb_blocks];
+        pos   = ra->fill_pos;
+        SDL_UnlockMutex(ra->mutex);
+        ret = avio_read(ra->src, block->data, READ_AHEAD_BLOCK_SIZE);
+        SDL_LockMutex(ra->mutex);
+        if (ra->seek_pos >= 0)
+            continue;
+        if (ret > 0) {
+            block->pos    = pos;
+            block->size   = ret;
+            ra->fill_pos += ret;
+            ra->nb_filled++;
+        } else if (ret == AVERROR_EOF || !ret) {
+            ra->eof = 1;
+        } else {
+            ra->error = ret;
+        }
+        SDL_CondSignal(ra->cond);
+    }
+    SDL_UnlockMutex(ra->mutex);
+    return 0;
+}
+
+static int read_ahead_read_packet(void *opaque, uint8_t *buf, int buf_size)
+{
+    ReadAhead *ra = opaque;
+    ReadAheadBlock *block;
+    int64_t stall_start = 0;
+    int ret;
+
+    SDL_LockMutex(ra->mutex);
+    for (;;) {
+        /* blocks before the read position are not needed anymore */
+        while (ra->nb_filled && ra->blocks[ra->rindex].pos + ra->blocks[ra->rindex].size <= ra->pos) {
+            ra->rindex = (ra->rindex + 1) % ra->nb_blocks;
+            ra->nb_filled--;
+            SDL_CondSignal(ra->cond);
+        }
+        block = &ra->blocks[ra->rindex];
+        if (ra->nb_filled && block->pos <= ra->pos) {
+            ret = FFMIN(buf_size, block->pos + block->size - ra->pos);
+            memcpy(buf, block->data + ra->pos - block->pos, ret);
+            ra->pos += ret;
+            break;
+        }
+        if (ra->seek_pos < 0 && (ra->nb_filled || ra->fill_pos != ra->pos)) {
+            /* the read position left the buffered range, refill from there */
+            ra->nb_filled = 0;
+            ra->seek_pos  = ra->pos;
+            SDL_CondSignal(ra->cond);
+        } else if (ra->seek_pos < 0 && (ra->eof || ra->error)) {
+            ret = ra->error ? ra->error : AVERROR_EOF;
+            break;
+        }
+        if (ra->interrupt_callback.callback && ra->interrupt_callback.callback(ra->interrupt_callback.opaque)) {
+            ret = AVERROR_EXIT;
+            break;
+        }
+        if (!stall_start)
+            stall_start = av_gettime_relative();
+        SDL_CondWaitTimeout(ra->cond, ra->mutex, 10);
+    }
+    if (stall_start) {
+        ra->misses++;
+        ra->stall_time += av_gettime_relative() - stall_start;
+    } else if (ret > 0) {
+        ra->hits++;
+    }
+    SDL_UnlockMutex(ra->mutex);
+    return ret;
+}
+
+static int64_t read_ahead_seek(void *opaque, int64_t offset, int whence)
+{
+    ReadAhead *ra = opaque;
+    int64_t pos;
+
+    switch (whence & ~AVSEEK_FORCE) {
+    case AVSEEK_SIZE:
+        return ra->size >= 0 ? ra->size : AVERROR(ENOSYS);
+    case SEEK_SET:
+        pos = offset;
+        break;
+    case SEEK_CUR:
+        pos = ra->pos + offset;
+        break;
+    case SEEK_END:
+        if (ra->size < 0)
+            return AVERROR(ENOSYS);
+        pos = ra->size + offset;
+        break;
+    default:
+        return AVERROR(EINVAL);
+    }
+    if (pos < 0)
+        return AVERROR(EINVAL);
+    /* the buffered blocks are discarded by the next read if pos is outside of them */
+    SDL_LockMutex(ra->mutex);
+    ra->pos = pos;
+    SDL_UnlockMutex(ra->mutex);
+    return pos;
+}
+
+static void read_ahead_close(AVIOContext **pb)
+{
+    ReadAhead *ra;
+    int i;
+
+    if (!*pb)
+        return;
+    ra = (*pb)->opaque;
+    if (ra->thread) {
+        SDL_LockMutex(ra->mutex);
+        ra->abort_request = 1;
+        SDL_CondSignal(ra->cond);
+        SDL_UnlockMutex(ra->mutex);
+        SDL_WaitThread(ra->thread, NULL);
+    }
+    for (i = 0; i < ra->nb_blocks; i++)
+        av_free(ra->blocks[i].data);
+    av_free(ra->blocks);
+    if (ra->cond)
+        SDL_DestroyCond(ra->cond);
+    if (ra->mutex)
+        SDL_DestroyMutex(ra->mutex);
+    avio_closep(&ra->src);
+    av_freep(&(*pb)->opaque);
+    av_freep(&(*pb)->buffer);
+    avio_context_free(pb);
+}
+
+/* Open filename and wrap it in an AVIOContext served from blocks read ahead by a separate thread,
+ * so the demuxer does not wait for the storage as long as it keeps up. */
+static int read_ahead_open(AVIOContext **pb, const char *filename, int megabytes,
+                           const AVIOInterruptCB *interrupt_callback, AVDictionary **options)
+{
+    ReadAhead *ra;
+    uint8_t *buffer;
+    int i, ret;
+
+    if (!(ra = av_mallocz(sizeof(*ra))))
+        return AVERROR(ENOMEM);
+    ra->interrupt_callback = *interrupt_callback;
+    ra->seek_pos = -1;
+    if ((ret = avio_open2(&ra->src, filename, AVIO_FLAG_READ, interrupt_callback, options)) < 0) {
+        av_free(ra);
+        return ret;
+    }
+    ra->size = avio_size(ra->src);
+
+    if (!(buffer = av_malloc(INPUT_IO_BUFFER_SIZE)) ||
+        !(*pb = avio_alloc_context(buffer, INPUT_IO_BUFFER_SIZE, 0, ra,
+                                   read_ahead_read_packet, NULL, read_ahead_seek))) {
+        av_free(buffer);
+        avio_closep(&ra->src);
+        av_free(ra);
+        return AVERROR(ENOMEM);
+    }
+    (*pb)->seekable = ra->src->seekable;
+
+    ra->nb_blocks = FFMAX(2, (int64_t)megabytes * 1024 * 1024 / READ_AHEAD_BLOCK_SIZE);
+    if (!(ra->blocks = av_mallocz_array(ra->nb_blocks, sizeof(*ra->blocks)))) {
+        ra->nb_blocks = 0;
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (i = 0; i < ra->nb_blocks; i++) {
+        if (!(ra->blocks[i].data = av_malloc(READ_AHEAD_BLOCK_SIZE))) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+    if (!(ra->mutex = SDL_CreateMutex()) || !(ra->cond = SDL_CreateCond()) ||
+        !(ra->thread = SDL_CreateThread(read_ahead_thread, "read_ahead_thread", ra))) {
+        av_log(NULL, AV_LOG_ERROR, "Could not start read-ahead: %s\n", SDL_GetError());
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    return 0;
+fail:
+    read_ahead_close(pb);
+    return ret;
+}
+
+static void print_benchmark(VideoState *is)
+{
+    if (nb_input_files > 1)
+        av_log(NULL, AV_LOG_INFO, "bench: input %d, %s\n", is->instance, is->filename);
+#if CONFIG_AVFILTER
+    av_log(NULL, AV_LOG_INFO, "bench: filter graphs video %d built %d reused, audio %d built %d reused\n",
+           is->vgraph_cache.nb_builds, is->vgraph_cache.nb_reuses,
+           is->agraph_cache.nb_builds, is->agraph_cache.nb_reuses);
+#endif
+    if (is->first_frame_time)
+        av_log(NULL, AV_LOG_INFO, "bench: first frame after %0.3f ms (%s)\n",
+               (is->first_frame_time - is->open_time) / 1000.0, is->ic ? is->ic->iformat->name : "?");
+    if (is->catch_up_changed) {
+        int64_t now = av_gettime_relative();
+        int i;
+
+        for (i = 0; i < CATCH_UP_LEVELS; i++)
+            av_log(NULL, AV_LOG_INFO, "bench: catch-up level %d for %0.3f s\n", i,
+                   (is->catch_up_time[i] + (i == is->catch_up_level ? now - is->catch_up_changed : 0)) / 1000000.0);
+    }
+    if (is->videoq.arena_size || is->audioq.arena_size)
+        av_log(NULL, AV_LOG_INFO, "bench: packets queued in the arena video %d audio %d subtitle %d, "
+               "on the heap video %d audio %d subtitle %d\n",
+               is->videoq.nb_arena_packets, is->audioq.nb_arena_packets, is->subtitleq.nb_arena_packets,
+               is->videoq.nb_heap_packets, is->audioq.nb_heap_packets, is->subtitleq.nb_heap_packets);
+    if (is->video_st)
+        av_log(NULL, AV_LOG_INFO, "bench: picture queue depth %d, from %d to %d, decoding %0.1f +- %0.1f ms a picture\n",
+               is->pictq.depth, is->pictq_depth_min, is->pictq_depth_max,
+               is->pictq_cost_mean * 1000, sqrt(is->pictq_cost_var) * 1000);
+    if (cadence && is->video_st) {
+        AVBPrint buf;
+        int i;
+
+        av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
+        for (i = 0; i <= CADENCE_MAX_SLOTS; i++)
+            av_bprintf(&buf, " %d%s:%d", i, i == CADENCE_MAX_SLOTS ? "+" : "", is->cadence_slots[i]);
+        av_log(NULL, AV_LOG_INFO, "bench: pictures by refresh intervals on screen%s, refresh interval %0.3f ms\n",
+               buf.str, vsync.interval * 1000);
+        av_bprint_finalize(&buf, NULL);
+    }
+    if (is->video_pool.nb_frames)
+        av_log(NULL, AV_LOG_INFO, "bench: video frame pool %d pictures, %d buffers allocated, %d of them while playing\n",
+               is->video_pool.nb_frames, is->video_pool.nb_allocs,
+               is->video_pool.nb_allocs - is->video_pool.nb_preallocs);
+    if (is->video_latency.count) {
+        const DecodeLatency *l = &is->video_latency;
+        av_log(NULL, AV_LOG_INFO, "bench: video decode latency p50 %d ms, p90 %d ms, p99 %d ms, max %s%d ms over %d pictures\n",
+               decode_latency_percentile(l, 0.5), decode_latency_percentile(l, 0.9),
+               decode_latency_percentile(l, 0.99), l->histogram[DECODE_LATENCY_MAX_MS] ? ">" : "",
+               decode_latency_percentile(l, 1.0), l->count);
+    }
+    if (is->live_latency_count)
+        av_log(NULL, AV_LOG_INFO, "bench: live latency %0.1f ms average, %0.1f ms max, jitter %0.1f ms, "
+               "buffer %0.1f ms, %d drops\n",
+               is->live_latency_sum * 1000 / is->live_latency_count, is->live_latency_max * 1000,
+               is->live_jitter * 1000, is->live_delay * 1000, is->live_drops);
+    if (is->demux_count)
+        av_log(NULL, AV_LOG_INFO, "bench: demux %d packets through %s, %0.3f ms per packet\n",
+               is->demux_count, is->mapped_pb ? "mapped file" : is->read_ahead_pb ? "read-ahead" : "default I/O",
+               is->demux_time / 1000.0 / is->demux_count);
+    if (is->read_ahead_pb) {
+        ReadAhead *ra = is->read_ahead_pb->opaque;
+        av_log(NULL, AV_LOG_INFO, "bench: read-ahead %d hits, %d misses, %0.3f ms stalled\n",
+               ra->hits, ra->misses, ra->stall_time / 1000.0);
+    }
+    if (is->sub_atlas.hits + is->sub_atlas.uploads)
+        av_log(NULL, AV_LOG_INFO, "bench: subtitle atlas %d bitmaps converted, %d reused\n",
+               is->sub_atlas.uploads, is->sub_atlas.hits);
+    if (is->waves_draw_count)
+        av_log(NULL, AV_LOG_INFO, "bench: waves display %d frames, %0.3f ms per frame, %s\n",
+               is->waves_draw_count, is->waves_draw_time / 1000.0 / is->waves_draw_count,
+               batch_waves ? "batched" : "one call per rectangle");
+}
+
 static void stream_close(VideoState *is)
 {
     /* XXX: use a special url_shutdown call to abort parse cleanly */
     is->abort_request = 1;
     SDL_WaitThread(is->read_tid, NULL);
 
+    if (benchmark)
+        print_benchmark(is);
+
     /* close each stream */
     if (is->audio_stream >= 0)
         stream_component_close(is, is->audio_stream);
@@ -1270,8 +2749,11 @@ static void stream_close(VideoState *is)
         stream_component_close(is, is->video_stream);
     if (is->subtitle_stream >= 0)
         stream_component_close(is, is->subtitle_stream);
+    alt_streams_close(is);
 
     avformat_close_input(&is->ic);
+    mapped_file_close(&is->mapped_pb);
+    read_ahead_close(&is->read_ahead_pb);
 
     packet_queue_destroy(&is->videoq);
     packet_queue_destroy(&is->audioq);
@@ -1283,53 +2765,236 @@ static void stream_close(VideoState *is)
     frame_queue_destory(&is->subpq);
     SDL_DestroyCond(is->continue_read_thread);
     sws_freeContext(is->img_convert_ctx);
-    sws_freeContext(is->sub_convert_ctx);
     av_free(is->filename);
+    av_freep(&is->wave_rects);
+    av_freep(&is->sample_array);
     if (is->vis_texture)
         SDL_DestroyTexture(is->vis_texture);
     if (is->vid_texture)
         SDL_DestroyTexture(is->vid_texture);
-    if (is->sub_texture)
-        SDL_DestroyTexture(is->sub_texture);
+    sub_atlas_destroy(&is->sub_atlas);
     av_free(is);
 }
 
-static void do_exit(VideoState *is)
+static void do_exit(void)
+{
+    /* read threads may still wait for SDL or the renderer */
+    startup_mark(STARTUP_SDL, 1);
+    startup_mark(STARTUP_RENDERER, 1);
+    if (playlist_next)
+        stream_close(playlist_next);
+    while (nb_streams)
+        stream_close(streams[--nb_streams]);
+    if (startup.audio_tid) {
+        audio_prepare_request(0, 0, 0);
+        SDL_WaitThread(startup.audio_tid, NULL);
+        if (startup.audio_out)
+            SDL_CloseAudioDevice(startup.audio_dev);
+        av_freep(&startup.audio_out);
+    }
+    if (renderer)
+        SDL_DestroyRenderer(renderer);
+    if (window)
+        SDL_DestroyWindow(window);
+    uninit_opts();
+#if CONFIG_AVFILTER
+    av_freep(&vfilters_list);
+#endif
+    avformat_network_deinit();
+    if (show_status)
+        printf("\n");
+    SDL_Quit();
+    av_log(NULL, AV_LOG_QUIET, "%s", "");
+    exit(0);
+}
+
+static void sigterm_handler(int sig)
+{
+    exit(123);
+}
+
+static void set_default_window_size(int width, int height, AVRational sar)
+{
+    SDL_Rect rect;
+    int max_width  = screen_width  ? screen_width  : INT_MAX;
+    int max_height = screen_height ? screen_height : INT_MAX;
+    if (max_width == INT_MAX && max_height == INT_MAX)
+        max_height = height;
+    calculate_display_rect(&rect, 0, 0, max_width, max_height, width, height, sar);
+    default_width  = rect.w;
+    default_height = rect.h;
+}
+
+/* number of instances sharing the window */
+static int nb_tiles(void)
+{
+    return playlist ? 1 : nb_input_files;
+}
+
+/* tile of the instance i among n sharing a window of the given size */
+static void layout_tile(int i, int n, int width, int height, int *x, int *y, int *w, int *h)
+{
+    int cols, rows, main_width;
+
+    if (n == 1) {
+        *x = *y = 0;
+        *w = width;
+        *h = height;
+    } else if (window_layout == LAYOUT_MOSAIC) {
+        main_width = width * 3 / 4;
+        *x = i ? main_width : 0;
+        *y = i ? (i - 1) * height / (n - 1) : 0;
+        *w = i ? width - main_width : main_width;
+        *h = i ? i * height / (n - 1) - *y : height;
+    } else {
+        cols = ceil(sqrt(n));
+        rows = (n + cols - 1) / cols;
+        *x = i % cols * width / cols;
+        *y = i / cols * height / rows;
+        *w = (i % cols + 1) * width  / cols - *x;
+        *h = (i / cols + 1) * height / rows - *y;
+    }
+}
+
+/* the tile of an instance, or the one it is going to get when the window opens */
+static void stream_tile_size(VideoState *is, int *w, int *h)
+{
+    int x, y;
+
+    if (is->width) {
+        *w = is->width;
+        *h = is->height;
+        return;
+    }
+    layout_tile(is->instance, nb_tiles(), screen_width  ? screen_width  : default_width,
+                screen_height ? screen_height : default_height, &x, &y, w, h);
+}
+
+/* lowest decoding resolution of a video still covering the tile of the instance */
+static int stream_auto_lowres(VideoState *is, const AVCodecParameters *par, int max_lowres)
+{
+    int tile_w, tile_h, l = 0;
+
+    stream_tile_size(is, &tile_w, &tile_h);
+    if (tile_w <= 0 || tile_h <= 0)
+        return 0;
+    while (l < max_lowres && par->width >> (l + 1) >= tile_w && par->height >> (l + 1) >= tile_h)
+        l++;
+    return l;
+}
+
+#if CONFIG_AVFILTER
+/* size a picture much bigger than the tile of the instance is scaled down to in the decoding
+   thread, rather than uploaded and drawn at full size, 0x0 if it is not */
+static void stream_scale_target(VideoState *is, AVFrame *frame, int *w, int *h)
+{
+    int tile_w, tile_h;
+
+    *w = *h = 0;
+    if (!auto_lowres)
+        return;
+    stream_tile_size(is, &tile_w, &tile_h);
+    if (tile_w > 0 && tile_h > 0 && frame->width >= 2 * tile_w && frame->height >= 2 * tile_h) {
+        *w = tile_w;
+        *h = tile_h;
+    }
+}
+#endif
+
+/* split a window of the given size among the instances */
+static void layout_streams(int width, int height)
+{
+    int i, x, y, w, h;
+
+    for (i = 0; i < nb_streams; i++) {
+        VideoState *is = streams[i];
+
+        layout_tile(i, nb_streams, width, height, &x, &y, &w, &h);
+        if ((w != is->width || h != is->height) && is->vis_texture) {
+            SDL_DestroyTexture(is->vis_texture);
+            is->vis_texture = NULL;
+        }
+        is->xleft  = x;
+        is->ytop   = y;
+        is->width  = w;
+        is->height = h;
+        is->force_refresh = 1;
+        if (is->video_st && is->video_max_lowres)
+            is->viddec.wanted_lowres = stream_auto_lowres(is, is->video_st->codecpar, is->video_max_lowres);
+    }
+}
+
+/* remove an instance which quit, the last one quits the program */
+static void stream_remove(VideoState *is)
+{
+    int i, w, h;
+
+    for (i = 0; i < nb_streams && streams[i] != is; i++)
+        ;
+    if (i == nb_streams) {
+        if (is == playlist_next) {
+            /* the next playlist item failed, skip it */
+            stream_close(is);
+            playlist_next = NULL;
+        }
+        return;
+    }
+    if (playlist) {
+        is->playlist_done = 1;
+        return;
+    }
+    if (nb_streams == 1)
+        do_exit();
+    stream_close(is);
+    memmove(&streams[i], &streams[i + 1], (nb_streams - i - 1) * sizeof(*streams));
+    nb_streams--;
+    if (focused_stream >= nb_streams)
+        focused_stream = nb_streams - 1;
+    if (streams[0]->width) {
+        SDL_GetWindowSize(window, &w, &h);
+        layout_streams(w, h);
+    }
+}
+
+static void vsync_query_display(void)
 {
-    if (is) {
-        stream_close(is);
+    SDL_DisplayMode mode;
+
+    if (!SDL_GetWindowDisplayMode(window, &mode) && mode.refresh_rate > 0)
+        vsync.interval = 1.0 / mode.refresh_rate;
+    else if (!vsync.interval)
+        vsync.interval = 1.0 / VSYNC_DEFAULT_RATE;
+    av_log(NULL, AV_LOG_VERBOSE, "Display refresh interval %0.3f ms\n", vsync.interval * 1000);
+}
+
+/* Follow the actual refresh interval from the times presents return, they wait for the vsync. Intervals
+ * far from the refresh interval, the renderer not waiting or vsyncs missed, only move the phase. */
+static void vsync_presented(double now)
+{
+    double n, measured;
+
+    if (vsync.last_present > 0 && vsync.interval > 0) {
+        n = round((now - vsync.last_present) / vsync.interval);
+        if (n >= 1 && n <= CADENCE_MAX_SLOTS) {
+            measured = (now - vsync.last_present) / n;
+            if (fabs(measured - vsync.interval) < 0.1 * vsync.interval)
+                vsync.interval += VSYNC_WEIGHT * (measured - vsync.interval);
+        }
     }
-    if (renderer)
-        SDL_DestroyRenderer(renderer);
-    if (window)
-        SDL_DestroyWindow(window);
-    uninit_opts();
-#if CONFIG_AVFILTER
-    av_freep(&vfilters_list);
-#endif
-    avformat_network_deinit();
-    if (show_status)
-        printf("\n");
-    SDL_Quit();
-    av_log(NULL, AV_LOG_QUIET, "%s", "");
-    exit(0);
+    vsync.last_present = now;
 }
 
-static void sigterm_handler(int sig)
+/* the vsync closest to a time */
+static double vsync_snap(double time)
 {
-    exit(123);
+    if (vsync.last_present <= 0 || vsync.interval <= 0)
+        return time;
+    return vsync.last_present + round((time - vsync.last_present) / vsync.interval) * vsync.interval;
 }
 
-static void set_default_window_size(int width, int height, AVRational sar)
+static int cadence_active(VideoState *is)
 {
-    SDL_Rect rect;
-    int max_width  = screen_width  ? screen_width  : INT_MAX;
-    int max_height = screen_height ? screen_height : INT_MAX;
-    if (max_width == INT_MAX && max_height == INT_MAX)
-        max_height = height;
-    calculate_display_rect(&rect, 0, 0, max_width, max_height, width, height, sar);
-    default_width  = rect.w;
-    default_height = rect.h;
+    return cadence && vsync.interval > 0 && !is->live;
 }
 
 static int video_open(VideoState *is)
@@ -1348,26 +3013,45 @@ static int video_open(VideoState *is)
     if (is_full_screen)
         SDL_SetWindowFullscreen(window, SDL_WINDOW_FULLSCREEN_DESKTOP);
     SDL_ShowWindow(window);
+    if (cadence)
+        vsync_query_display();
 
-    is->width  = w;
-    is->height = h;
+    layout_streams(w, h);
 
     return 0;
 }
 
-/* display the current picture, if any */
-static void video_display(VideoState *is)
+/* Compose the window from the last shown picture or the visualization of every instance and present
+ * it. Called once per pass of the refresh loop whatever the number of instances asking for display;
+ * pictures already uploaded to their texture are only copied. */
+static void display_streams(void)
 {
-    if (!is->width)
-        video_open(is);
+    int i;
 
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
-    if (is->audio_st && is->show_mode != SHOW_MODE_VIDEO)
-        video_audio_display(is);
-    else if (is->video_st)
-        video_image_display(is);
+    for (i = 0; i < nb_streams; i++) {
+        VideoState *s = streams[i];
+        if (!s->width)
+            continue;
+        if (s->audio_st && s->show_mode != SHOW_MODE_VIDEO)
+            video_audio_display(s);
+        else if (s->video_st && s->pictq.rindex_shown)
+            video_image_display(s);
+        s->vis_due = 0;
+    }
     SDL_RenderPresent(renderer);
+    if (cadence)
+        vsync_presented(av_gettime_relative() / 1000000.0);
+    display_pending = 0;
+}
+
+/* display the current picture, if any */
+static void video_display(VideoState *is)
+{
+    if (!is->width)
+        video_open(is);
+    display_pending = 1;
 }
 
 static double get_clock(Clock *c)
@@ -1434,6 +3118,12 @@ static int get_master_sync_type(VideoState *is) {
     }
 }
 
+/* -cadence makes the video the master clock, it still has to drop the pictures it is late for */
+static int framedrop_active(VideoState *is)
+{
+    return framedrop > 0 || (framedrop && (get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER || cadence_active(is)));
+}
+
 /* get the current master clock value */
 static double get_master_clock(VideoState *is)
 {
@@ -1467,6 +3157,86 @@ static void check_external_clock_speed(VideoState *is) {
    }
 }
 
+/* time from the arrival of what is presented to now, jitter buffer and decoding included */
+static double live_latency(VideoState *is)
+{
+    double clock = is->video_st ? get_clock(&is->vidclk) : get_master_clock(is);
+
+    if (!is->live_packets)
+        return NAN;
+    return av_gettime_relative() / 1000000.0 - is->live_offset - clock;
+}
+
+/* keep the external clock the depth of the jitter buffer behind the arrival of the packets */
+static void check_live_clock(VideoState *is)
+{
+    double time = av_gettime_relative() / 1000000.0;
+    double target, diff, latency;
+
+    if (!is->live_packets)
+        return;
+    target = time - is->live_offset - is->live_delay;
+    diff = target - get_clock(&is->extclk);
+    if (isnan(diff) || fabs(diff) > LIVE_RESYNC_THRESHOLD)
+        set_clock(&is->extclk, target, is->extclk.serial);
+    else
+        set_clock_speed(&is->extclk, av_clipd(1.0 + diff, LIVE_CLOCK_SPEED_MIN, LIVE_CLOCK_SPEED_MAX));
+
+    latency = live_latency(is);
+    if (!isnan(latency)) {
+        is->live_latency_sum += latency;
+        is->live_latency_max = FFMAX(is->live_latency_max, latency);
+        is->live_latency_count++;
+    }
+}
+
+/* measure the arrival of a packet of the stream the live clock follows, and size the jitter
+ * buffer from it */
+static void live_packet_arrived(VideoState *is, AVPacket *pkt)
+{
+    AVStream *st = is->video_st ? is->video_st : is->audio_st;
+    int64_t ts = pkt->dts != AV_NOPTS_VALUE ? pkt->dts : pkt->pts;
+    double transit;
+
+    if (!st || pkt->stream_index != st->index || ts == AV_NOPTS_VALUE)
+        return;
+    transit = av_gettime_relative() / 1000000.0 - ts * av_q2d(st->time_base);
+    if (!is->live_packets || fabs(transit - is->live_offset) > AV_NOSYNC_THRESHOLD) {
+        is->live_offset = transit;
+    } else {
+        is->live_jitter += (fabs(transit - is->live_transit) - is->live_jitter) / 16;
+        /* follow the smallest transit, slowly forgetting it in case the clocks of both ends drift */
+        if (transit < is->live_offset)
+            is->live_offset = transit;
+        else
+            is->live_offset += (transit - is->live_offset) / 512;
+    }
+    is->live_transit = transit;
+    is->live_packets++;
+    is->live_delay = av_clipd(LIVE_JITTER_FACTOR * is->live_jitter, LIVE_MIN_DELAY, LIVE_MAX_DELAY);
+}
+
+/* drop everything queued when the latency grew past the jitter buffer, at a packet decoding can
+ * restart from */
+static void live_drain_queues(VideoState *is, AVPacket *pkt)
+{
+    AVStream *st = is->video_st ? is->video_st : is->audio_st;
+    double latency;
+
+    if (!st || pkt->stream_index != st->index || (is->video_st && !(pkt->flags & AV_PKT_FLAG_KEY)))
+        return;
+    latency = live_latency(is);
+    if (isnan(latency) || latency < is->live_delay + LIVE_DROP_THRESHOLD)
+        return;
+    av_log(NULL, AV_LOG_VERBOSE, "%s: %0.0f ms behind, dropping queued packets\n",
+           is->filename, latency * 1000);
+    if (is->video_stream >= 0)
+        packet_queue_flush(&is->videoq);
+    if (is->audio_stream >= 0)
+        packet_queue_flush(&is->audioq);
+    is->live_drops++;
+}
+
 /* seek in the stream */
 static void stream_seek(VideoState *is, int64_t pos, int64_t rel, int seek_by_bytes)
 {
@@ -1577,12 +3347,15 @@ static void video_refresh(void *opaque, double *remaining_time)
 
     Frame *sp, *sp2;
 
-    if (!is->paused && get_master_sync_type(is) == AV_SYNC_EXTERNAL_CLOCK && is->realtime)
+    if (!is->paused && is->live)
+        check_live_clock(is);
+    else if (!is->paused && get_master_sync_type(is) == AV_SYNC_EXTERNAL_CLOCK && is->realtime)
         check_external_clock_speed(is);
 
     if (!display_disable && is->show_mode != SHOW_MODE_VIDEO && is->audio_st) {
         time = av_gettime_relative() / 1000000.0;
         if (is->force_refresh || is->last_vis_time + rdftspeed < time) {
+            is->vis_due = 1;
             video_display(is);
             is->last_vis_time = time;
         }
@@ -1594,7 +3367,7 @@ retry:
         if (frame_queue_nb_remaining(&is->pictq) == 0) {
             // nothing to do, no picture to display in the queue
         } else {
-            double last_duration, duration, delay;
+            double last_duration, duration, delay, early;
             Frame *vp, *lastvp;
 
             /* dequeue the picture */
@@ -1606,8 +3379,11 @@ retry:
                 goto retry;
             }
 
-            if (lastvp->serial != vp->serial)
-                is->frame_timer = av_gettime_relative() / 1000000.0;
+            if (lastvp->serial != vp->serial) {
+                is->frame_timer = vsync_snap(av_gettime_relative() / 1000000.0);
+                is->cadence_frac = 0;
+                is->cadence_known = 0;
+            }
 
             if (is->paused)
                 goto display;
@@ -1615,16 +3391,25 @@ retry:
             /* compute nominal last_duration */
             last_duration = vp_duration(is, lastvp, vp);
             delay = compute_target_delay(last_duration, is);
+            early = 0;
+            if (cadence_active(is)) {
+                /* shown on whole refresh intervals, rendered half of one before its vsync */
+                if (is->cadence_known)
+                    delay = is->cadence_delay;
+                early = vsync.interval / 2;
+            }
 
             time= av_gettime_relative()/1000000.0;
-            if (time < is->frame_timer + delay) {
-                *remaining_time = FFMIN(is->frame_timer + delay - time, *remaining_time);
+            if (time < is->frame_timer + delay - early) {
+                *remaining_time = FFMIN(is->frame_timer + delay - early - time, *remaining_time);
                 goto display;
             }
 
             is->frame_timer += delay;
             if (delay > 0 && time - is->frame_timer > AV_SYNC_THRESHOLD_MAX)
                 is->frame_timer = time;
+            if (cadence_active(is))
+                is->frame_timer = vsync_snap(is->frame_timer);
 
             SDL_LockMutex(is->pictq.mutex);
             if (!isnan(vp->pts))
@@ -1634,7 +3419,25 @@ retry:
             if (frame_queue_nb_remaining(&is->pictq) > 1) {
                 Frame *nextvp = frame_queue_peek_next(&is->pictq);
                 duration = vp_duration(is, vp, nextvp);
-                if(!is->step && (framedrop>0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) && time > is->frame_timer + duration){
+                if(!is->step && framedrop_active(is) && time > is->frame_timer + duration){
+                    is->frame_drops_late++;
+                    frame_queue_next(&is->pictq);
+                    goto retry;
+                }
+            }
+
+            if (cadence_active(is)) {
+                /* the refresh intervals of the picture are known once it is picked, one given none is
+                 * skipped without being rendered, its present would take a vsync */
+                Frame *nextvp = frame_queue_nb_remaining(&is->pictq) > 1 ? frame_queue_peek_next(&is->pictq) : NULL;
+                int slots;
+
+                duration = nextvp && nextvp->serial == vp->serial ? vp_duration(is, vp, nextvp) : vp->duration;
+                slots = cadence_schedule(compute_target_delay(duration, is), vsync.interval,
+                                         &is->cadence_frac, &is->cadence_delay);
+                is->cadence_slots[FFMIN(slots, CADENCE_MAX_SLOTS)]++;
+                is->cadence_known = 1;
+                if (!slots && nextvp && !is->step) {
                     is->frame_drops_late++;
                     frame_queue_next(&is->pictq);
                     goto retry;
@@ -1654,20 +3457,6 @@ retry:
                             || (is->vidclk.pts > (sp->pts + ((float) sp->sub.end_display_time / 1000)))
                             || (sp2 && is->vidclk.pts > (sp2->pts + ((float) sp2->sub.start_display_time / 1000))))
                     {
-                        if (sp->uploaded) {
-                            int i;
-                            for (i = 0; i < sp->sub.num_rects; i++) {
-                                AVSubtitleRect *sub_rect = sp->sub.rects[i];
-                                uint8_t *pixels;
-                                int pitch, j;
-
-                                if (!SDL_LockTexture(is->sub_texture, (SDL_Rect *)sub_rect, (void **)&pixels, &pitch)) {
-                                    for (j = 0; j < sub_rect->h; j++, pixels += pitch)
-                                        memset(pixels, 0, sub_rect->w << 2);
-                                    SDL_UnlockTexture(is->sub_texture);
-                                }
-                            }
-                        }
                         frame_queue_next(&is->subpq);
                     } else {
                         break;
@@ -1687,7 +3476,7 @@ display:
             video_display(is);
     }
     is->force_refresh = 0;
-    if (show_status) {
+    if (show_status && is == streams[focused_stream]) {
         AVBPrint buf;
         static int64_t last_time;
         int64_t cur_time;
@@ -1714,8 +3503,10 @@ display:
                 av_diff = get_master_clock(is) - get_clock(&is->audclk);
 
             av_bprint_init(&buf, 0, AV_BPRINT_SIZE_AUTOMATIC);
+            if (nb_streams > 1)
+                av_bprintf(&buf, "[%d] ", is->instance);
             av_bprintf(&buf,
-                      "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB f=%"PRId64"/%"PRId64"   \r",
+                      "%7.2f %s:%7.3f fd=%4d aq=%5dKB vq=%5dKB sq=%5dB f=%"PRId64"/%"PRId64,
                       get_master_clock(is),
                       (is->audio_st && is->video_st) ? "A-V" : (is->video_st ? "M-V" : (is->audio_st ? "M-A" : "   ")),
                       av_diff,
@@ -1725,6 +3516,11 @@ display:
                       sqsize,
                       is->video_st ? is->viddec.avctx->pts_correction_num_faulty_dts : 0,
                       is->video_st ? is->viddec.avctx->pts_correction_num_faulty_pts : 0);
+            if (is->video_st)
+                av_bprintf(&buf, " pq=%2d", is->pictq.depth);
+            if (is->live)
+                av_bprintf(&buf, " lat=%4.0fms buf=%3.0fms", live_latency(is) * 1000, is->live_delay * 1000);
+            av_bprintf(&buf, "   \r");
 
             if (show_status == 1 && AV_LOG_INFO > av_log_get_level())
                 fprintf(stderr, "%s", buf.str);
@@ -1763,13 +3559,85 @@ static int queue_picture(VideoState *is, AVFrame *src_frame, double pts, double
     vp->pos = pos;
     vp->serial = serial;
 
-    set_default_window_size(vp->width, vp->height, vp->sar);
+    if (!is->instance)
+        set_default_window_size(vp->width, vp->height, vp->sar);
 
     av_frame_move_ref(vp->frame, src_frame);
     frame_queue_push(&is->pictq);
     return 0;
 }
 
+/* Skip more or less of the decoding depending on how late the decoded pictures are, dropping them
+ * after decoding wastes the time that was missing. Non-reference frames go first. */
+static void update_catch_up(VideoState *is, double lag)
+{
+    AVCodecContext *avctx = is->viddec.avctx;
+    int64_t now = av_gettime_relative();
+    int level = is->catch_up_level;
+    const CatchUpLevel *l;
+
+    if (lag > CATCH_UP_BEHIND && level < CATCH_UP_LEVELS - 1 &&
+        now - is->catch_up_changed >= CATCH_UP_RAISE_HOLD)
+        level++;
+    else if (lag < CATCH_UP_CAUGHT_UP && level > 0 &&
+             now - is->catch_up_changed >= CATCH_UP_LOWER_HOLD)
+        level--;
+    else
+        return;
+
+    is->catch_up_time[is->catch_up_level] += now - is->catch_up_changed;
+    is->catch_up_changed = now;
+    is->catch_up_level = level;
+    l = &catch_up_levels[level];
+    avctx->skip_loop_filter = FFMAX(is->catch_up_base.skip_loop_filter, l->skip_loop_filter);
+    avctx->skip_idct        = FFMAX(is->catch_up_base.skip_idct,        l->skip_idct);
+    avctx->skip_frame       = FFMAX(is->catch_up_base.skip_frame,       l->skip_frame);
+    av_log(NULL, AV_LOG_VERBOSE, "%s: video %0.3f s late, catch-up level %d\n", is->filename, lag, level);
+}
+
+/* Size the picture queue so that its pictures cover the decoding times above their mean, as long as it
+ * fits in the memory budget. */
+static void pictq_update_depth(VideoState *is, int64_t cost, double duration, AVFrame *frame)
+{
+    FrameQueue *f = &is->pictq;
+    double c = cost / 1000000.0, diff = c - is->pictq_cost_mean;
+    int64_t now = av_gettime_relative();
+    int64_t bytes = 0;
+    int i, wanted, budget;
+
+    if (!is->pictq_cost_mean)
+        diff = 0, is->pictq_cost_mean = c;
+    is->pictq_cost_mean += PICTQ_COST_WEIGHT * diff;
+    is->pictq_cost_var   = (1 - PICTQ_COST_WEIGHT) * (is->pictq_cost_var + PICTQ_COST_WEIGHT * diff * diff);
+    if (!adaptive_pictq || duration <= 0)
+        return;
+
+    wanted = PICTQ_MIN_DEPTH + (int)ceil((PICTQ_JITTER_SIGMAS * sqrt(is->pictq_cost_var) +
+                                          FFMAX(is->pictq_cost_mean - duration, 0)) / duration);
+    for (i = 0; i < AV_NUM_DATA_POINTERS && frame->buf[i]; i++)
+        bytes += frame->buf[i]->size;
+    budget = bytes ? FFMIN((int64_t)pictq_budget * 1024 * 1024 / bytes, f->max_size) : f->max_size;
+    wanted = av_clip(wanted, PICTQ_MIN_DEPTH, FFMAX(budget, PICTQ_MIN_DEPTH));
+
+    if (wanted < f->depth) {
+        if (!is->pictq_shrink_since)
+            is->pictq_shrink_since = now;
+        if (now - is->pictq_shrink_since < PICTQ_SHRINK_HOLD)
+            return;
+        wanted = f->depth - 1;
+    }
+    is->pictq_shrink_since = 0;
+    if (wanted == f->depth)
+        return;
+    av_log(NULL, AV_LOG_DEBUG, "picture queue depth %d -> %d, decoding %0.1f +- %0.1f ms a %0.1f ms picture\n",
+           f->depth, wanted, is->pictq_cost_mean * 1000, sqrt(is->pictq_cost_var) * 1000, duration * 1000);
+    SDL_LockMutex(f->mutex);
+    f->depth = wanted;
+    SDL_UnlockMutex(f->mutex);
+    is->pictq_depth_min = FFMIN(is->pictq_depth_min, wanted);
+    is->pictq_depth_max = FFMAX(is->pictq_depth_max, wanted);
+}
+
 static int get_video_frame(VideoState *is, AVFrame *frame)
 {
     int got_picture;
@@ -1785,9 +3653,12 @@ static int get_video_frame(VideoState *is, AVFrame *frame)
 
         frame->sample_aspect_ratio = av_guess_sample_aspect_ratio(is->ic, is->video_st, frame);
 
-        if (framedrop>0 || (framedrop && get_master_sync_type(is) != AV_SYNC_VIDEO_MASTER)) {
+        if (framedrop_active(is)) {
             if (frame->pts != AV_NOPTS_VALUE) {
                 double diff = dpts - get_master_clock(is);
+                if (catch_up && !isnan(diff) && fabs(diff) < AV_NOSYNC_THRESHOLD &&
+                    is->viddec.pkt_serial == is->vidclk.serial)
+                    update_catch_up(is, -diff);
                 if (!isnan(diff) && fabs(diff) < AV_NOSYNC_THRESHOLD &&
                     diff - is->frame_last_filter_delay < 0 &&
                     is->viddec.pkt_serial == is->vidclk.serial &&
@@ -1847,7 +3718,8 @@ fail:
     return ret;
 }
 
-static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const char *vfilters, AVFrame *frame)
+static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const char *vfilters, AVFrame *frame,
+                                   int scale_w, int scale_h)
 {
     enum AVPixelFormat pix_fmts[FF_ARRAY_ELEMS(sdl_texture_format_map)];
     char sws_flags_str[512] = "";
@@ -1924,6 +3796,12 @@ static int configure_video_filters(AVFilterGraph *graph, VideoState *is, const c
     last_filter = filt_ctx;                                                  \
 } while (0)
 
+    if (scale_w && scale_h) {
+        char scale_buf[64];
+        snprintf(scale_buf, sizeof(scale_buf), "w=%d:h=%d:force_original_aspect_ratio=decrease", scale_w, scale_h);
+        INSERT_FILT("scale", scale_buf);
+    }
+
     if (autorotate) {
         int32_t *displaymatrix = (int32_t *)av_stream_get_side_data(is->video_st, AV_PKT_DATA_DISPLAYMATRIX, NULL);
         double theta = get_rotation(displaymatrix);
@@ -2028,6 +3906,168 @@ end:
         avfilter_graph_free(&is->agraph);
     return ret;
 }
+
+static int filter_graph_key_equal(const FilterGraphKey *a, const FilterGraphKey *b)
+{
+    if (a->filters != b->filters && (!a->filters || !b->filters || strcmp(a->filters, b->filters)))
+        return 0;
+    return a->width == b->width && a->height == b->height && a->format == b->format &&
+           a->channel_layout == b->channel_layout && !av_cmp_q(a->time_base, b->time_base) &&
+           a->scale_width == b->scale_width && a->scale_height == b->scale_height;
+}
+
+/* A graph made only of these filters outputs every frame as soon as it gets it, so dropping what
+ * is left in the sink after a seek is enough to flush it. Others, like fps, yadif or a resampling
+ * aresample, keep frames or state and are rebuilt on seek as before. */
+static int filter_graph_is_stateless(AVFilterGraph *graph, int allow_aresample)
+{
+    static const char * const stateless_filters[] = {
+        "buffer", "buffersink", "abuffer", "abuffersink", "null", "anull",
+        "format", "aformat", "scale", "crop", "pad", "hflip", "vflip", "transpose", "rotate",
+        "setsar", "setdar", "eq", "lut", "lutyuv", "lutrgb", "negate", "drawbox", "volume", "pan",
+        NULL
+    };
+    int i, j;
+
+    for (i = 0; i < graph->nb_filters; i++) {
+        const char *name = graph->filters[i]->filter->name;
+        if (allow_aresample && !strcmp(name, "aresample"))
+            continue;
+        for (j = 0; stateless_filters[j]; j++)
+            if (!strcmp(name, stateless_filters[j]))
+                break;
+        if (!stateless_filters[j])
+            return 0;
+    }
+    return 1;
+}
+
+static void filter_graph_drain(AVFilterContext *sink)
+{
+    AVFrame *frame = av_frame_alloc();
+    if (!frame)
+        return;
+    while (av_buffersink_get_frame_flags(sink, frame, 0) >= 0)
+        av_frame_unref(frame);
+    av_frame_free(&frame);
+}
+
+static CachedFilterGraph *filter_graph_cache_find(FilterGraphCache *c, const FilterGraphKey *key)
+{
+    int i;
+    for (i = 0; i < c->nb_graphs; i++)
+        if (filter_graph_key_equal(&c->graphs[i].key, key))
+            return &c->graphs[i];
+    return NULL;
+}
+
+static int filter_graph_cache_contains(FilterGraphCache *c, AVFilterGraph *graph)
+{
+    int i;
+    for (i = 0; i < c->nb_graphs; i++)
+        if (c->graphs[i].graph == graph)
+            return 1;
+    return 0;
+}
+
+static void filter_graph_cache_remove(FilterGraphCache *c, CachedFilterGraph *cached)
+{
+    avfilter_graph_free(&cached->graph);
+    *cached = c->graphs[--c->nb_graphs];
+}
+
+/* take ownership of a newly configured graph, evicting the oldest one if the cache is full */
+static void filter_graph_cache_add(FilterGraphCache *c, const FilterGraphKey *key, AVFilterGraph *graph,
+                                   AVFilterContext *in, AVFilterContext *out, int reusable)
+{
+    CachedFilterGraph *cached;
+
+    if (c->nb_graphs == FILTER_GRAPH_CACHE_SIZE) {
+        avfilter_graph_free(&c->graphs[0].graph);
+        memmove(&c->graphs[0], &c->graphs[1], (FILTER_GRAPH_CACHE_SIZE - 1) * sizeof(c->graphs[0]));
+        c->nb_graphs--;
+    }
+    cached = &c->graphs[c->nb_graphs++];
+    cached->key      = *key;
+    cached->graph    = graph;
+    cached->in       = in;
+    cached->out      = out;
+    cached->reusable = reusable;
+    c->nb_builds++;
+}
+
+static void filter_graph_cache_free(FilterGraphCache *c)
+{
+    while (c->nb_graphs)
+        filter_graph_cache_remove(c, &c->graphs[c->nb_graphs - 1]);
+}
+
+/* make is->agraph a graph configured for is->audio_filter_src, reusing a cached one when possible */
+static int get_audio_filter_graph(VideoState *is)
+{
+    FilterGraphCache *cache = &is->agraph_cache;
+    FilterGraphKey key = { afilters, is->audio_filter_src.freq, is->audio_filter_src.channels,
+                           is->audio_filter_src.fmt, is->audio_filter_src.channel_layout,
+                           { 1, is->audio_filter_src.freq } };
+    CachedFilterGraph *cached = filter_graph_cache_find(cache, &key);
+    int ret;
+
+    if (cached && cached->reusable) {
+        filter_graph_drain(cached->out);
+        is->agraph           = cached->graph;
+        is->in_audio_filter  = cached->in;
+        is->out_audio_filter = cached->out;
+        cache->nb_reuses++;
+        return 0;
+    }
+    if (cached) {
+        if (is->agraph == cached->graph)
+            is->agraph = NULL;
+        filter_graph_cache_remove(cache, cached);
+    }
+    /* configure_audio_filters() frees is->agraph, which must not happen to a cached graph */
+    if (filter_graph_cache_contains(cache, is->agraph))
+        is->agraph = NULL;
+    if ((ret = configure_audio_filters(is, afilters, 1)) < 0)
+        return ret;
+    filter_graph_cache_add(cache, &key, is->agraph, is->in_audio_filter, is->out_audio_filter,
+                           filter_graph_is_stateless(is->agraph, is->audio_filter_src.freq == is->audio_tgt.freq));
+    return 0;
+}
+
+/* point filt_in and filt_out to a graph configured for frame and scaling it down to scale_w x scale_h,
+ * reusing a cached one when possible */
+static int get_video_filter_graph(VideoState *is, AVFrame *frame, int scale_w, int scale_h,
+                                  AVFilterContext **filt_in, AVFilterContext **filt_out)
+{
+    FilterGraphCache *cache = &is->vgraph_cache;
+    FilterGraphKey key = { vfilters_list ? vfilters_list[is->vfilter_idx] : NULL, frame->width, frame->height,
+                           frame->format, 0, is->video_st->time_base, scale_w, scale_h };
+    CachedFilterGraph *cached = filter_graph_cache_find(cache, &key);
+    AVFilterGraph *graph;
+    int ret;
+
+    if (cached && cached->reusable) {
+        filter_graph_drain(cached->out);
+        cache->nb_reuses++;
+    } else {
+        if (cached)
+            filter_graph_cache_remove(cache, cached);
+        if (!(graph = avfilter_graph_alloc()))
+            return AVERROR(ENOMEM);
+        graph->nb_threads = filter_nbthreads;
+        if ((ret = configure_video_filters(graph, is, key.filters, frame, key.scale_width, key.scale_height)) < 0) {
+            avfilter_graph_free(&graph);
+            return ret;
+        }
+        filter_graph_cache_add(cache, &key, graph, is->in_video_filter, is->out_video_filter,
+                               filter_graph_is_stateless(graph, 0));
+        cached = &cache->graphs[cache->nb_graphs - 1];
+    }
+    *filt_in  = is->in_video_filter  = cached->in;
+    *filt_out = is->out_video_filter = cached->out;
+    return 0;
+}
 #endif  /* CONFIG_AVFILTER */
 
 static int audio_thread(void *arg)
@@ -2079,7 +4119,7 @@ static int audio_thread(void *arg)
                     is->audio_filter_src.freq           = frame->sample_rate;
                     last_serial                         = is->auddec.pkt_serial;
 
-                    if ((ret = configure_audio_filters(is, afilters, 1)) < 0)
+                    if ((ret = get_audio_filter_graph(is)) < 0)
                         goto the_end;
                 }
 
@@ -2089,6 +4129,11 @@ static int audio_thread(void *arg)
             while ((ret = av_buffersink_get_frame_flags(is->out_audio_filter, frame, 0)) >= 0) {
                 tb = av_buffersink_get_time_base(is->out_audio_filter);
 #endif
+                if (is->auddec.pkt_serial == is->audio_skip_serial && frame->pts != AV_NOPTS_VALUE &&
+                    frame->pts * av_q2d(tb) + (double)frame->nb_samples / frame->sample_rate < is->audio_skip_until) {
+                    av_frame_unref(frame);
+                    continue;
+                }
                 if (!(af = frame_queue_peek_writable(&is->sampq)))
                     goto the_end;
 
@@ -2111,7 +4156,10 @@ static int audio_thread(void *arg)
     } while (ret >= 0 || ret == AVERROR(EAGAIN) || ret == AVERROR_EOF);
  the_end:
 #if CONFIG_AVFILTER
+    if (filter_graph_cache_contains(&is->agraph_cache, is->agraph))
+        is->agraph = NULL;
     avfilter_graph_free(&is->agraph);
+    filter_graph_cache_free(&is->agraph_cache);
 #endif
     av_frame_free(&frame);
     return ret;
@@ -2137,15 +4185,17 @@ static int video_thread(void *arg)
     int ret;
     AVRational tb = is->video_st->time_base;
     AVRational frame_rate = av_guess_frame_rate(is->ic, is->video_st, NULL);
+    int64_t busy_since = av_gettime_relative(), busy_wait = is->viddec.packet_wait;
 
 #if CONFIG_AVFILTER
-    AVFilterGraph *graph = NULL;
     AVFilterContext *filt_out = NULL, *filt_in = NULL;
     int last_w = 0;
     int last_h = 0;
     enum AVPixelFormat last_format = -2;
     int last_serial = -1;
     int last_vfilter_idx = 0;
+    int last_scale_w = 0, last_scale_h = 0;
+    int scale_w, scale_h;
 #endif
 
     if (!frame)
@@ -2159,38 +4209,34 @@ static int video_thread(void *arg)
             continue;
 
 #if CONFIG_AVFILTER
+        stream_scale_target(is, frame, &scale_w, &scale_h);
         if (   last_w != frame->width
             || last_h != frame->height
             || last_format != frame->format
             || last_serial != is->viddec.pkt_serial
-            || last_vfilter_idx != is->vfilter_idx) {
+            || last_vfilter_idx != is->vfilter_idx
+            || last_scale_w != scale_w
+            || last_scale_h != scale_h) {
             av_log(NULL, AV_LOG_DEBUG,
                    "Video frame changed from size:%dx%d format:%s serial:%d to size:%dx%d format:%s serial:%d\n",
                    last_w, last_h,
                    (const char *)av_x_if_null(av_get_pix_fmt_name(last_format), "none"), last_serial,
                    frame->width, frame->height,
                    (const char *)av_x_if_null(av_get_pix_fmt_name(frame->format), "none"), is->viddec.pkt_serial);
-            avfilter_graph_free(&graph);
-            graph = avfilter_graph_alloc();
-            if (!graph) {
-                ret = AVERROR(ENOMEM);
-                goto the_end;
-            }
-            graph->nb_threads = filter_nbthreads;
-            if ((ret = configure_video_filters(graph, is, vfilters_list ? vfilters_list[is->vfilter_idx] : NULL, frame)) < 0) {
+            if ((ret = get_video_filter_graph(is, frame, scale_w, scale_h, &filt_in, &filt_out)) < 0) {
                 SDL_Event event;
                 event.type = FF_QUIT_EVENT;
                 event.user.data1 = is;
                 SDL_PushEvent(&event);
                 goto the_end;
             }
-            filt_in  = is->in_video_filter;
-            filt_out = is->out_video_filter;
             last_w = frame->width;
             last_h = frame->height;
             last_format = frame->format;
             last_serial = is->viddec.pkt_serial;
             last_vfilter_idx = is->vfilter_idx;
+            last_scale_w = scale_w;
+            last_scale_h = scale_h;
             frame_rate = av_buffersink_get_frame_rate(filt_out);
         }
 
@@ -2216,7 +4262,12 @@ static int video_thread(void *arg)
 #endif
             duration = (frame_rate.num && frame_rate.den ? av_q2d((AVRational){frame_rate.den, frame_rate.num}) : 0);
             pts = (frame->pts == AV_NOPTS_VALUE) ? NAN : frame->pts * av_q2d(tb);
+            /* the time producing the picture, not the time waiting for its packets or for room for it */
+            pictq_update_depth(is, av_gettime_relative() - busy_since - (is->viddec.packet_wait - busy_wait),
+                               duration, frame);
             ret = queue_picture(is, frame, pts, duration, frame->pkt_pos, is->viddec.pkt_serial);
+            busy_since = av_gettime_relative();
+            busy_wait  = is->viddec.packet_wait;
             av_frame_unref(frame);
 #if CONFIG_AVFILTER
             if (is->videoq.serial != is->viddec.pkt_serial)
@@ -2229,7 +4280,7 @@ static int video_thread(void *arg)
     }
  the_end:
 #if CONFIG_AVFILTER
-    avfilter_graph_free(&graph);
+    filter_graph_cache_free(&is->vgraph_cache);
 #endif
     av_frame_free(&frame);
     return 0;
@@ -2259,6 +4310,8 @@ static int subtitle_thread(void *arg)
             sp->width = is->subdec.avctx->width;
             sp->height = is->subdec.avctx->height;
             sp->uploaded = 0;
+            /* on failure the conversion is retried by the display */
+            prepare_subtitle_bitmaps(sp);
 
             /* now we can update the picture count */
             frame_queue_push(&is->subpq);
@@ -2276,13 +4329,13 @@ static void update_sample_display(VideoState *is, short *samples, int samples_si
 
     size = samples_size / sizeof(short);
     while (size > 0) {
-        len = SAMPLE_ARRAY_SIZE - is->sample_array_index;
+        len = is->sample_array_size - is->sample_array_index;
         if (len > size)
             len = size;
         memcpy(is->sample_array + is->sample_array_index, samples, len * sizeof(short));
         samples += len;
         is->sample_array_index += len;
-        if (is->sample_array_index >= SAMPLE_ARRAY_SIZE)
+        if (is->sample_array_index >= is->sample_array_size)
             is->sample_array_index = 0;
         size -= len;
     }
@@ -2314,6 +4367,11 @@ static int synchronize_audio(VideoState *is, int nb_samples)
                     wanted_nb_samples = nb_samples + (int)(diff * is->audio_src.freq);
                     min_nb_samples = ((nb_samples * (100 - SAMPLE_CORRECTION_PERCENT_MAX) / 100));
                     max_nb_samples = ((nb_samples * (100 + SAMPLE_CORRECTION_PERCENT_MAX) / 100));
+                    if (cadence_active(is)) {
+                        /* a drift too small to hear, the video keeps its cadence */
+                        min_nb_samples = FFMAX(min_nb_samples, (int)floor(nb_samples * (1 - CADENCE_SAMPLE_CORRECTION_MAX)));
+                        max_nb_samples = FFMIN(max_nb_samples, (int)ceil(nb_samples * (1 + CADENCE_SAMPLE_CORRECTION_MAX)));
+                    }
                     wanted_nb_samples = av_clip(wanted_nb_samples, min_nb_samples, max_nb_samples);
                 }
                 av_log(NULL, AV_LOG_TRACE, "diff=%f adiff=%f sample_diff=%d apts=%0.3f %f\n",
@@ -2352,7 +4410,7 @@ static int audio_decode_frame(VideoState *is)
     do {
 #if defined(_WIN32)
         while (frame_queue_nb_remaining(&is->sampq) == 0) {
-            if ((av_gettime_relative() - audio_callback_time) > 1000000LL * is->audio_hw_buf_size / is->audio_tgt.bytes_per_sec / 2)
+            if ((av_gettime_relative() - is->audio_callback_time) > 1000000LL * is->audio_hw_buf_size / is->audio_tgt.bytes_per_sec / 2)
                 return -1;
             av_usleep (1000);
         }
@@ -2450,23 +4508,47 @@ static int audio_decode_frame(VideoState *is)
     return resampled_data_size;
 }
 
+/* pass the output on to the pre-rolled playlist item once all the samples of the current one were
+ * played, called with the device locked */
+static int audio_handover(AudioOutput *out)
+{
+    VideoState *is = out->is;
+    VideoState *next = is->audio_successor;
+
+    if (!next || is->paused || is->auddec.finished != is->audioq.serial ||
+        frame_queue_nb_remaining(&is->sampq))
+        return 0;
+    next->audio_callback_time = is->audio_callback_time;
+    next->audio_handed_over = 1;
+    is->audio_successor = NULL;
+    out->is = next;
+    return 1;
+}
+
 /* prepare a new audio buffer */
 static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
 {
-    VideoState *is = opaque;
+    AudioOutput *out = opaque;
+    VideoState *is = out->is;
     int audio_size, len1;
 
-    audio_callback_time = av_gettime_relative();
+    is->audio_callback_time = av_gettime_relative();
 
     while (len > 0) {
         if (is->audio_buf_index >= is->audio_buf_size) {
            audio_size = audio_decode_frame(is);
+           if (audio_size < 0 && audio_handover(out)) {
+               is = out->is;
+               continue;
+           }
            if (audio_size < 0) {
                 /* if error, just output silence */
                is->audio_buf = NULL;
                is->audio_buf_size = SDL_AUDIO_MIN_BUFFER_SIZE / is->audio_tgt.frame_size * is->audio_tgt.frame_size;
            } else {
-               if (is->show_mode != SHOW_MODE_VIDEO)
+               if (!startup.printed && !is->video_st)
+                   startup_print();
+               if (is->show_mode != SHOW_MODE_VIDEO && is->sample_array)
                    update_sample_display(is, (int16_t *)is->audio_buf, audio_size);
                is->audio_buf_size = audio_size;
            }
@@ -2489,12 +4571,13 @@ static void sdl_audio_callback(void *opaque, Uint8 *stream, int len)
     is->audio_write_buf_size = is->audio_buf_size - is->audio_buf_index;
     /* Let's assume the audio driver that is used by SDL has two periods. */
     if (!isnan(is->audio_clock)) {
-        set_clock_at(&is->audclk, is->audio_clock - (double)(2 * is->audio_hw_buf_size + is->audio_write_buf_size) / is->audio_tgt.bytes_per_sec, is->audio_clock_serial, audio_callback_time / 1000000.0);
+        set_clock_at(&is->audclk, is->audio_clock - (double)(2 * is->audio_hw_buf_size + is->audio_write_buf_size) / is->audio_tgt.bytes_per_sec, is->audio_clock_serial, is->audio_callback_time / 1000000.0);
         sync_clock_to_slave(&is->extclk, &is->audclk);
     }
 }
 
-static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb_channels, int wanted_sample_rate, struct AudioParams *audio_hw_params)
+static int audio_device_open(AudioOutput **pout, SDL_AudioDeviceID *pdev, int live,
+                             int64_t wanted_channel_layout, int wanted_nb_channels, int wanted_sample_rate, struct AudioParams *audio_hw_params)
 {
     SDL_AudioSpec wanted_spec, spec;
     const char *env;
@@ -2522,10 +4605,14 @@ static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb
         next_sample_rate_idx--;
     wanted_spec.format = AUDIO_S16SYS;
     wanted_spec.silence = 0;
-    wanted_spec.samples = FFMAX(SDL_AUDIO_MIN_BUFFER_SIZE, 2 << av_log2(wanted_spec.freq / SDL_AUDIO_MAX_CALLBACKS_PER_SEC));
+    wanted_spec.samples = FFMAX(SDL_AUDIO_MIN_BUFFER_SIZE, 2 << av_log2(wanted_spec.freq /
+                                (live ? LIVE_AUDIO_CALLBACKS_PER_SEC : SDL_AUDIO_MAX_CALLBACKS_PER_SEC)));
     wanted_spec.callback = sdl_audio_callback;
-    wanted_spec.userdata = opaque;
-    while (!(audio_dev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE))) {
+    if (!(*pout = av_mallocz(sizeof(**pout))))
+        return AVERROR(ENOMEM);
+    (*pout)->refcount = 1;
+    wanted_spec.userdata = *pout;
+    while (!(*pdev = SDL_OpenAudioDevice(NULL, 0, &wanted_spec, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE))) {
         av_log(NULL, AV_LOG_WARNING, "SDL_OpenAudio (%d channels, %d Hz): %s\n",
                wanted_spec.channels, wanted_spec.freq, SDL_GetError());
         wanted_spec.channels = next_nb_channels[FFMIN(7, wanted_spec.channels)];
@@ -2535,6 +4622,7 @@ static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb
             if (!wanted_spec.freq) {
                 av_log(NULL, AV_LOG_ERROR,
                        "No more combinations to try, audio open failed\n");
+                av_freep(pout);
                 return -1;
             }
         }
@@ -2554,17 +4642,285 @@ static int audio_open(void *opaque, int64_t wanted_channel_layout, int wanted_nb
         }
     }
 
-    audio_hw_params->fmt = AV_SAMPLE_FMT_S16;
-    audio_hw_params->freq = spec.freq;
-    audio_hw_params->channel_layout = wanted_channel_layout;
-    audio_hw_params->channels =  spec.channels;
-    audio_hw_params->frame_size = av_samples_get_buffer_size(NULL, audio_hw_params->channels, 1, audio_hw_params->fmt, 1);
-    audio_hw_params->bytes_per_sec = av_samples_get_buffer_size(NULL, audio_hw_params->channels, audio_hw_params->freq, audio_hw_params->fmt, 1);
-    if (audio_hw_params->bytes_per_sec <= 0 || audio_hw_params->frame_size <= 0) {
-        av_log(NULL, AV_LOG_ERROR, "av_samples_get_buffer_size failed\n");
-        return -1;
+    audio_hw_params->fmt = AV_SAMPLE_FMT_S16;
+    audio_hw_params->freq = spec.freq;
+    audio_hw_params->channel_layout = wanted_channel_layout;
+    audio_hw_params->channels =  spec.channels;
+    audio_hw_params->frame_size = av_samples_get_buffer_size(NULL, audio_hw_params->channels, 1, audio_hw_params->fmt, 1);
+    audio_hw_params->bytes_per_sec = av_samples_get_buffer_size(NULL, audio_hw_params->channels, audio_hw_params->freq, audio_hw_params->fmt, 1);
+    if (audio_hw_params->bytes_per_sec <= 0 || audio_hw_params->frame_size <= 0) {
+        av_log(NULL, AV_LOG_ERROR, "av_samples_get_buffer_size failed\n");
+        return -1;
+    }
+    return spec.size;
+}
+
+static int audio_open(VideoState *is, int64_t wanted_channel_layout, int wanted_nb_channels, int wanted_sample_rate, struct AudioParams *audio_hw_params)
+{
+    int ret = audio_device_open(&is->audio_out, &is->audio_dev, is->live,
+                                wanted_channel_layout, wanted_nb_channels, wanted_sample_rate, audio_hw_params);
+    if (is->audio_out)
+        is->audio_out->is = is;
+    return ret;
+}
+
+/* Open the audio device with the parameters of the first audio stream as soon as it is selected, while
+ * the video decoder and then the audio decoder and filters are opened. The parameters come from the probed
+ * stream, so the device cannot be opened during probing. */
+static int audio_prepare_thread(void *arg)
+{
+    int ret = -1;
+
+    SDL_LockMutex(startup.mutex);
+    while (!startup.audio_wanted)
+        SDL_CondWait(startup.cond, startup.mutex);
+    SDL_UnlockMutex(startup.mutex);
+
+    if (startup.audio_wanted > 0) {
+        startup_mark(STARTUP_AUDIO_DEVICE, 0);
+        ret = audio_device_open(&startup.audio_out, &startup.audio_dev, live_mode, startup.audio_wanted_layout,
+                                startup.audio_wanted_channels, startup.audio_wanted_rate, &startup.audio_tgt);
+        if (ret < 0) {
+            if (startup.audio_out)
+                SDL_CloseAudioDevice(startup.audio_dev);
+            av_freep(&startup.audio_out);
+        }
+    }
+    startup.audio_hw_buf_size = ret;
+    startup_mark(STARTUP_AUDIO_DEVICE, 1);
+    return 0;
+}
+
+/* Give the prepared audio device to a stream wanting the output it was opened for, returns whether it
+ * took the device. The device not taken by the first audio stream is closed. */
+static int audio_prepared_take(VideoState *is, int nb_channels, int sample_rate)
+{
+    int taken = 0;
+
+    /* the device is prepared if the thread is started by the time SDL is initialized */
+    startup_wait(STARTUP_SDL);
+    if (!startup.audio_tid)
+        return 0;
+    startup_wait(STARTUP_AUDIO_DEVICE);
+    SDL_LockMutex(startup.mutex);
+    if (startup.audio_out && nb_channels == startup.audio_wanted_channels &&
+        sample_rate == startup.audio_wanted_rate && is->live == live_mode) {
+        is->audio_out         = startup.audio_out;
+        is->audio_out->is     = is;
+        is->audio_dev         = startup.audio_dev;
+        is->audio_tgt         = startup.audio_tgt;
+        is->audio_hw_buf_size = startup.audio_hw_buf_size;
+        startup.audio_out     = NULL;
+        taken = 1;
+    } else if (startup.audio_out) {
+        SDL_CloseAudioDevice(startup.audio_dev);
+        av_freep(&startup.audio_out);
+    }
+    SDL_UnlockMutex(startup.mutex);
+    return taken;
+}
+
+static void frame_pool_free(void *opaque, uint8_t *data)
+{
+    av_free(opaque);
+}
+
+#if HAVE_MMAP && defined(MADV_HUGEPAGE)
+static void frame_pool_unmap(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(intptr_t)opaque);
+}
+#elif HAVE_MAPVIEWOFFILE
+static void frame_pool_virtual_free(void *opaque, uint8_t *data)
+{
+    VirtualFree(data, 0, MEM_RELEASE);
+}
+#endif
+
+/* a buffer on huge pages, NULL if the system does not give any */
+static AVBufferRef *frame_pool_alloc_huge(int size)
+{
+    AVBufferRef *buf = NULL;
+#if HAVE_MMAP && defined(MADV_HUGEPAGE)
+    size_t mapped = FFALIGN((size_t)size, HUGE_PAGE_SIZE);
+    uint8_t *data = mmap(NULL, mapped, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+
+    if (data == MAP_FAILED)
+        return NULL;
+    madvise(data, mapped, MADV_HUGEPAGE);
+    if (!(buf = av_buffer_create(data, size, frame_pool_unmap, (void *)(intptr_t)mapped, 0)))
+        munmap(data, mapped);
+#elif HAVE_MAPVIEWOFFILE
+    SIZE_T page = GetLargePageMinimum();
+    uint8_t *data;
+
+    /* large pages need the SeLockMemoryPrivilege, without it this fails and the heap is used */
+    if (!page || !(data = VirtualAlloc(NULL, FFALIGN((SIZE_T)size, page),
+                                       MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE)))
+        return NULL;
+    if (!(buf = av_buffer_create(data, size, frame_pool_virtual_free, NULL, 0)))
+        VirtualFree(data, 0, MEM_RELEASE);
+#endif
+    return buf;
+}
+
+static AVBufferRef *frame_pool_alloc(void *opaque, int size)
+{
+    FramePool *fp = opaque;
+    AVBufferRef *buf = NULL;
+    uint8_t *raw;
+
+    if (huge_pages)
+        buf = frame_pool_alloc_huge(size);
+    if (!buf) {
+        if (!(raw = av_malloc(size + FRAME_POOL_ALIGN - 1)))
+            return NULL;
+        buf = av_buffer_create((uint8_t *)FFALIGN((uintptr_t)raw, FRAME_POOL_ALIGN), size,
+                               frame_pool_free, raw, 0);
+        if (!buf) {
+            av_free(raw);
+            return NULL;
+        }
+    }
+    fp->nb_allocs++;
+    return buf;
+}
+
+/* Size the pool for pictures of the given size and format and fill it with as many buffers as the
+ * picture queue at its deepest and the decoder references can hold, so that playback allocates no more. */
+static int frame_pool_configure(FramePool *fp, AVCodecContext *avctx, int width, int height, int format)
+{
+    AVBufferRef *bufs[FRAME_QUEUE_SIZE + 32];
+    int linesize_align[AV_NUM_DATA_POINTERS];
+    ptrdiff_t linesizes[4];
+    size_t sizes[4], size;
+    int w = width, h = height, unaligned, nb_bufs, allocs, i, ret;
+
+    avcodec_align_dimensions2(avctx, &w, &h, linesize_align);
+    do {
+        if ((ret = av_image_fill_linesizes(fp->linesize, format, w)) < 0)
+            return ret;
+        unaligned = 0;
+        for (i = 0; i < 4; i++)
+            unaligned |= fp->linesize[i] % FRAME_POOL_ALIGN;
+        w += w & ~(w - 1);
+    } while (unaligned);
+    for (i = 0; i < 4; i++)
+        linesizes[i] = fp->linesize[i];
+    if ((ret = av_image_fill_plane_sizes(sizes, format, h, linesizes)) < 0)
+        return ret;
+    size = 0;
+    for (i = 0; i < 4; i++) {
+        fp->offset[i] = size;
+        size = FFALIGN(size + sizes[i], FRAME_POOL_ALIGN);
+    }
+    size += FRAME_POOL_PADDING;
+    if (size > INT_MAX)
+        return AVERROR(EINVAL);
+
+    av_buffer_pool_uninit(&fp->pool);
+    if (!(fp->pool = av_buffer_pool_init2(size, fp, frame_pool_alloc, NULL)))
+        return AVERROR(ENOMEM);
+    fp->width  = width;
+    fp->height = height;
+    fp->format = format;
+
+    /* pictures queued, referenced by the decoder, being decoded by each frame thread; an adaptive
+       queue grows as far as pictq_budget allows, see pictq_update_depth() */
+    nb_bufs = VIDEO_PICTURE_QUEUE_SIZE;
+    if (adaptive_pictq)
+        nb_bufs = FFMAX(FFMIN((int64_t)pictq_budget * 1024 * 1024 / size, FRAME_QUEUE_SIZE), PICTQ_MIN_DEPTH);
+    nb_bufs += FFMAX(avctx->refs, 1) + 2 +
+              (avctx->active_thread_type & FF_THREAD_FRAME ? avctx->thread_count : 0);
+    nb_bufs = FFMIN(nb_bufs, (int)FF_ARRAY_ELEMS(bufs));
+    allocs = fp->nb_allocs;
+    for (i = 0; i < nb_bufs; i++)
+        if (!(bufs[i] = av_buffer_pool_get(fp->pool)))
+            break;
+    while (i > 0)
+        av_buffer_unref(&bufs[--i]);
+    fp->nb_preallocs += fp->nb_allocs - allocs;
+    av_log(NULL, AV_LOG_VERBOSE, "Frame pool of %d buffers of %d bytes for %dx%d %s\n",
+           fp->nb_allocs - allocs, (int)size, width, height, av_get_pix_fmt_name(format));
+    return 0;
+}
+
+static int video_get_buffer2(AVCodecContext *avctx, AVFrame *frame, int flags)
+{
+    FramePool *fp = avctx->opaque;
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(frame->format);
+    int i, ret = 0;
+
+    if (!(avctx->codec->capabilities & AV_CODEC_CAP_DR1) || !desc || desc->flags & FRAME_POOL_UNSUPPORTED)
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+
+    /* frame threads ask for buffers concurrently */
+    SDL_LockMutex(fp->mutex);
+    if (!fp->pool || fp->width != frame->width || fp->height != frame->height || fp->format != frame->format)
+        ret = frame_pool_configure(fp, avctx, frame->width, frame->height, frame->format);
+    if (ret >= 0 && !(frame->buf[0] = av_buffer_pool_get(fp->pool)))
+        ret = AVERROR(ENOMEM);
+    if (ret >= 0) {
+        for (i = 0; i < 4; i++) {
+            frame->linesize[i] = fp->linesize[i];
+            frame->data[i]     = fp->linesize[i] ? frame->buf[0]->data + fp->offset[i] : NULL;
+        }
+        frame->extended_data = frame->data;
+        fp->nb_frames++;
+    }
+    SDL_UnlockMutex(fp->mutex);
+    if (ret < 0)
+        return avcodec_default_get_buffer2(avctx, frame, flags);
+    return 0;
+}
+
+static int frame_pool_init(FramePool *fp, AVCodecContext *avctx)
+{
+    memset(fp, 0, sizeof(*fp));
+    if (!(fp->mutex = SDL_CreateMutex())) {
+        av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
+        return AVERROR(ENOMEM);
+    }
+    avctx->opaque      = fp;
+    avctx->get_buffer2 = video_get_buffer2;
+    return 0;
+}
+
+/* the buffers still referenced by frames are freed when those are */
+static void frame_pool_uninit(FramePool *fp)
+{
+    av_buffer_pool_uninit(&fp->pool);
+    SDL_DestroyMutex(fp->mutex);
+    fp->mutex = NULL;
+}
+
+/* Pick how a video decoder uses threads and return their number, 0 for as many as cores. Frame
+ * threading keeps a picture in flight per thread, which costs latency but scales with the cores;
+ * slice threading outputs each picture as soon as it is decoded but only helps codecs and
+ * resolutions with several slices per picture. */
+static int set_decode_threading(VideoState *is, AVCodecContext *avctx, const AVCodec *codec)
+{
+    int policy = decode_policy;
+
+    if (avctx->codec_type != AVMEDIA_TYPE_VIDEO)
+        return 0;
+    if (policy == DECODE_POLICY_AUTO)
+        policy = is->live || is->realtime ? DECODE_POLICY_LATENCY : DECODE_POLICY_THROUGHPUT;
+
+    if (policy == DECODE_POLICY_LATENCY) {
+        avctx->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        avctx->thread_type = FF_THREAD_SLICE;
+        av_log(NULL, AV_LOG_VERBOSE, "%s: low delay decoding, %s\n", is->filename,
+               codec->capabilities & AV_CODEC_CAP_SLICE_THREADS ? "slice threads" : "single thread");
+        /* a decoder with frame threads only would hold pictures back */
+        return codec->capabilities & AV_CODEC_CAP_SLICE_THREADS ? 0 : 1;
     }
-    return spec.size;
+    avctx->thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE;
+    av_log(NULL, AV_LOG_VERBOSE, "%s: throughput decoding, frame threads\n", is->filename);
+    /* small pictures are decoded faster than many threads can be fed */
+    if (avctx->width * avctx->height <= DECODE_SMALL_PICTURE)
+        return FFMIN(av_cpu_count(), DECODE_SMALL_PICTURE_THREADS);
+    return 0;
 }
 
 /* open a given stream. Return 0 if OK */
@@ -2580,6 +4936,7 @@ static int stream_component_open(VideoState *is, int stream_index)
     int64_t channel_layout;
     int ret = 0;
     int stream_lowres = lowres;
+    int threads;
 
     if (stream_index < 0 || stream_index >= ic->nb_streams)
         return -1;
@@ -2612,6 +4969,12 @@ static int stream_component_open(VideoState *is, int stream_index)
     }
 
     avctx->codec_id = codec->id;
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO && !lowres && auto_lowres) {
+        /* decode at the lowest resolution still covering the tile, and follow its size */
+        stream_lowres = stream_auto_lowres(is, ic->streams[stream_index]->codecpar, codec->max_lowres);
+        if (stream_lowres)
+            av_log(NULL, AV_LOG_VERBOSE, "Decoding %s at lowres %d\n", is->filename, stream_lowres);
+    }
     if (stream_lowres > codec->max_lowres) {
         av_log(avctx, AV_LOG_WARNING, "The maximum value for lowres supported by the decoder is %d\n",
                 codec->max_lowres);
@@ -2621,10 +4984,17 @@ static int stream_component_open(VideoState *is, int stream_index)
 
     if (fast)
         avctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    threads = set_decode_threading(is, avctx, codec);
+    if (avctx->codec_type == AVMEDIA_TYPE_VIDEO && frame_pool && (ret = frame_pool_init(&is->video_pool, avctx)) < 0)
+        goto fail;
 
     opts = filter_codec_opts(codec_opts, avctx->codec_id, ic, ic->streams[stream_index], codec);
-    if (!av_dict_get(opts, "threads", NULL, 0))
-        av_dict_set(&opts, "threads", "auto", 0);
+    if (!av_dict_get(opts, "threads", NULL, 0)) {
+        if (threads)
+            av_dict_set_int(&opts, "threads", threads, 0);
+        else
+            av_dict_set(&opts, "threads", "auto", 0);
+    }
     if (stream_lowres)
         av_dict_set_int(&opts, "lowres", stream_lowres, 0);
     if ((ret = avcodec_open2(avctx, codec, &opts)) < 0) {
@@ -2661,10 +5031,20 @@ static int stream_component_open(VideoState *is, int stream_index)
         channel_layout = avctx->channel_layout;
 #endif
 
-        /* prepare audio output */
-        if ((ret = audio_open(is, channel_layout, nb_channels, sample_rate, &is->audio_tgt)) < 0)
-            goto fail;
-        is->audio_hw_buf_size = ret;
+        /* prepare audio output, a pre-rolled playlist item goes on with the one of the item playing */
+        if (is->preceding && is->preceding->audio_out) {
+            is->audio_tgt         = is->preceding->audio_tgt;
+            is->audio_hw_buf_size = is->preceding->audio_hw_buf_size;
+            is->audio_dev         = is->preceding->audio_dev;
+            is->audio_out         = is->preceding->audio_out;
+            SDL_LockAudioDevice(is->audio_dev);
+            is->audio_out->refcount++;
+            SDL_UnlockAudioDevice(is->audio_dev);
+        } else if (!audio_prepared_take(is, nb_channels, sample_rate)) {
+            if ((ret = audio_open(is, channel_layout, nb_channels, sample_rate, &is->audio_tgt)) < 0)
+                goto fail;
+            is->audio_hw_buf_size = ret;
+        }
         is->audio_src = is->audio_tgt;
         is->audio_buf_size  = 0;
         is->audio_buf_index = 0;
@@ -2687,14 +5067,28 @@ static int stream_component_open(VideoState *is, int stream_index)
         }
         if ((ret = decoder_start(&is->auddec, audio_thread, "audio_decoder", is)) < 0)
             goto out;
-        SDL_PauseAudioDevice(audio_dev, 0);
+        if (is->audio_out->is != is) {
+            SDL_LockAudioDevice(is->audio_dev);
+            is->preceding->audio_successor = is;
+            SDL_UnlockAudioDevice(is->audio_dev);
+        } else if (!is->preceding) {
+            SDL_PauseAudioDevice(is->audio_dev, 0);
+        }
         break;
     case AVMEDIA_TYPE_VIDEO:
         is->video_stream = stream_index;
         is->video_st = ic->streams[stream_index];
+        is->catch_up_base.skip_loop_filter = avctx->skip_loop_filter;
+        is->catch_up_base.skip_idct        = avctx->skip_idct;
+        is->catch_up_base.skip_frame       = avctx->skip_frame;
+        is->catch_up_level   = 0;
+        is->catch_up_changed = av_gettime_relative();
 
         if ((ret = decoder_init(&is->viddec, avctx, &is->videoq, is->continue_read_thread)) < 0)
             goto fail;
+        is->video_max_lowres = !lowres && auto_lowres ? codec->max_lowres : 0;
+        if (benchmark)
+            is->viddec.latency = &is->video_latency;
         if ((ret = decoder_start(&is->viddec, video_thread, "video_decoder", is)) < 0)
             goto out;
         is->queue_attachments_req = 1;
@@ -2714,6 +5108,8 @@ static int stream_component_open(VideoState *is, int stream_index)
     goto out;
 
 fail:
+    if (avctx && avctx->opaque == &is->video_pool)
+        frame_pool_uninit(&is->video_pool);
     avcodec_free_context(&avctx);
 out:
     av_dict_free(&opts);
@@ -2750,6 +5146,419 @@ static int is_realtime(AVFormatContext *s)
     return 0;
 }
 
+/* Probing results of local files are kept in probe_cache_dir, one file per input named after the MD5
+ * of its path. Each is an AVDictionary string holding the path, size and modification time the
+ * results belong to, the input format, the start time and duration, the number of streams after
+ * the header and after probing, the streams chosen by av_find_best_stream() and, as nested
+ * dictionary strings, the parameters of every stream. */
+static int probe_cache_key(const char *filename, char **path, char **key)
+{
+    const char *protocol = avio_find_protocol_name(filename);
+    uint8_t md5[16];
+    char name[33];
+    struct stat st;
+    int i;
+
+    if (!probe_cache_dir || !protocol || strcmp(protocol, "file"))
+        return AVERROR(ENOTSUP);
+    av_strstart(filename, "file:", &filename);
+    if (stat(filename, &st) < 0)
+        return AVERROR(errno);
+
+    av_md5_sum(md5, (const uint8_t *)filename, strlen(filename));
+    for (i = 0; i < 16; i++)
+        snprintf(name + 2 * i, 3, "%02x", md5[i]);
+    *path = av_asprintf("%s/%s.probe", probe_cache_dir, name);
+    *key  = av_asprintf("%s|%"PRId64"|%"PRId64, filename, (int64_t)st.st_size, (int64_t)st.st_mtime);
+    if (!*path || !*key) {
+        av_freep(path);
+        av_freep(key);
+        return AVERROR(ENOMEM);
+    }
+    return 0;
+}
+
+static int64_t probe_cache_get_int(AVDictionary *d, const char *key, int64_t def)
+{
+    AVDictionaryEntry *e = av_dict_get(d, key, NULL, AV_DICT_MATCH_CASE);
+    return e ? strtoll(e->value, NULL, 10) : def;
+}
+
+/* return the cached results of filename, or NULL if it has none or they do not match it anymore */
+static AVDictionary *probe_cache_load(const char *filename)
+{
+    AVDictionary *entry = NULL;
+    AVDictionaryEntry *e;
+    AVIOContext *pb = NULL;
+    AVBPrint buf;
+    char *path, *key;
+
+    if (probe_cache_key(filename, &path, &key) < 0)
+        return NULL;
+    av_bprint_init(&buf, 0, AV_BPRINT_SIZE_UNLIMITED);
+    if (avio_open(&pb, path, AVIO_FLAG_READ) >= 0 &&
+        avio_read_to_bprint(pb, &buf, INT_MAX) >= 0 && av_bprint_is_complete(&buf) &&
+        av_dict_parse_string(&entry, buf.str, "=", "\n", 0) >= 0 &&
+        (e = av_dict_get(entry, "key", NULL, AV_DICT_MATCH_CASE)) && !strcmp(e->value, key)) {
+        av_log(NULL, AV_LOG_VERBOSE, "%s: using probing results cached in %s\n", filename, path);
+    } else {
+        av_dict_free(&entry);
+    }
+    avio_closep(&pb);
+    av_bprint_finalize(&buf, NULL);
+    av_free(path);
+    av_free(key);
+    return entry;
+}
+
+/* Fill the streams of ic from a cache entry, fails if they are not the ones it was made from.
+ * Returns 1 when the entry is valid but the demuxer creates streams while reading packets,
+ * like FLV or MPEG-TS do, these still have to be probed. */
+static int probe_cache_apply(AVFormatContext *ic, AVDictionary *entry)
+{
+    int i;
+
+    if (probe_cache_get_int(entry, "header_streams", -1) != ic->nb_streams)
+        return AVERROR_INVALIDDATA;
+    if (probe_cache_get_int(entry, "nb_streams", -1) != ic->nb_streams)
+        return 1;
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        AVDictionary *d = NULL;
+        AVDictionaryEntry *e;
+        char name[32];
+
+        snprintf(name, sizeof(name), "stream.%d", i);
+        if (!(e = av_dict_get(entry, name, NULL, AV_DICT_MATCH_CASE)) ||
+            av_dict_parse_string(&d, e->value, "=", ":", 0) < 0 ||
+            probe_cache_get_int(d, "codec_type", AVMEDIA_TYPE_UNKNOWN) != par->codec_type) {
+            av_dict_free(&d);
+            return AVERROR_INVALIDDATA;
+        }
+        par->codec_id            = probe_cache_get_int(d, "codec_id", par->codec_id);
+        par->format              = probe_cache_get_int(d, "format", par->format);
+        par->width               = probe_cache_get_int(d, "width", par->width);
+        par->height              = probe_cache_get_int(d, "height", par->height);
+        par->sample_rate         = probe_cache_get_int(d, "sample_rate", par->sample_rate);
+        par->channels            = probe_cache_get_int(d, "channels", par->channels);
+        par->channel_layout      = probe_cache_get_int(d, "channel_layout", par->channel_layout);
+        par->frame_size          = probe_cache_get_int(d, "frame_size", par->frame_size);
+        par->profile             = probe_cache_get_int(d, "profile", par->profile);
+        par->level               = probe_cache_get_int(d, "level", par->level);
+        par->bit_rate            = probe_cache_get_int(d, "bit_rate", par->bit_rate);
+        if ((e = av_dict_get(d, "sample_aspect_ratio", NULL, AV_DICT_MATCH_CASE)))
+            av_parse_ratio(&par->sample_aspect_ratio, e->value, INT_MAX, 0, NULL);
+        if ((e = av_dict_get(d, "avg_frame_rate", NULL, AV_DICT_MATCH_CASE)))
+            av_parse_ratio(&st->avg_frame_rate, e->value, INT_MAX, 0, NULL);
+        if ((e = av_dict_get(d, "r_frame_rate", NULL, AV_DICT_MATCH_CASE)))
+            av_parse_ratio(&st->r_frame_rate, e->value, INT_MAX, 0, NULL);
+        if (!par->extradata && (e = av_dict_get(d, "extradata", NULL, AV_DICT_MATCH_CASE))) {
+            int j, size = strlen(e->value) / 2;
+            if (size && (par->extradata = av_mallocz(size + AV_INPUT_BUFFER_PADDING_SIZE))) {
+                for (j = 0; j < size; j++)
+                    sscanf(e->value + 2 * j, "%2hhx", &par->extradata[j]);
+                par->extradata_size = size;
+            }
+        }
+        av_dict_free(&d);
+    }
+    if (ic->start_time == AV_NOPTS_VALUE)
+        ic->start_time = probe_cache_get_int(entry, "start_time", AV_NOPTS_VALUE);
+    if (ic->duration == AV_NOPTS_VALUE)
+        ic->duration = probe_cache_get_int(entry, "duration", AV_NOPTS_VALUE);
+    return 0;
+}
+
+/* write the probing results of ic, with st_index unless the streams were not picked automatically,
+ * header_streams being the number of streams the header created */
+static void probe_cache_store(const char *filename, AVFormatContext *ic, int header_streams, const int *st_index)
+{
+    AVDictionary *entry = NULL;
+    AVIOContext *pb = NULL;
+    AVBPrint extradata;
+    char *path, *key, *str;
+    char name[32], ratio[32];
+    int i, j, ret;
+
+    if (probe_cache_key(filename, &path, &key) < 0)
+        return;
+    av_dict_set(&entry, "key", key, AV_DICT_DONT_STRDUP_VAL);
+    av_dict_set(&entry, "format", ic->iformat->name, 0);
+    av_dict_set_int(&entry, "start_time", ic->start_time, 0);
+    av_dict_set_int(&entry, "duration", ic->duration, 0);
+    av_dict_set_int(&entry, "header_streams", header_streams, 0);
+    av_dict_set_int(&entry, "nb_streams", ic->nb_streams, 0);
+    if (st_index) {
+        av_dict_set_int(&entry, "video", st_index[AVMEDIA_TYPE_VIDEO], 0);
+        av_dict_set_int(&entry, "audio", st_index[AVMEDIA_TYPE_AUDIO], 0);
+        av_dict_set_int(&entry, "subtitle", st_index[AVMEDIA_TYPE_SUBTITLE], 0);
+    }
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+        AVCodecParameters *par = st->codecpar;
+        AVDictionary *d = NULL;
+
+        av_dict_set_int(&d, "codec_type", par->codec_type, 0);
+        av_dict_set_int(&d, "codec_id", par->codec_id, 0);
+        av_dict_set_int(&d, "format", par->format, 0);
+        av_dict_set_int(&d, "width", par->width, 0);
+        av_dict_set_int(&d, "height", par->height, 0);
+        av_dict_set_int(&d, "sample_rate", par->sample_rate, 0);
+        av_dict_set_int(&d, "channels", par->channels, 0);
+        av_dict_set_int(&d, "channel_layout", par->channel_layout, 0);
+        av_dict_set_int(&d, "frame_size", par->frame_size, 0);
+        av_dict_set_int(&d, "profile", par->profile, 0);
+        av_dict_set_int(&d, "level", par->level, 0);
+        av_dict_set_int(&d, "bit_rate", par->bit_rate, 0);
+        snprintf(ratio, sizeof(ratio), "%d/%d", par->sample_aspect_ratio.num, par->sample_aspect_ratio.den);
+        av_dict_set(&d, "sample_aspect_ratio", ratio, 0);
+        snprintf(ratio, sizeof(ratio), "%d/%d", st->avg_frame_rate.num, st->avg_frame_rate.den);
+        av_dict_set(&d, "avg_frame_rate", ratio, 0);
+        snprintf(ratio, sizeof(ratio), "%d/%d", st->r_frame_rate.num, st->r_frame_rate.den);
+        av_dict_set(&d, "r_frame_rate", ratio, 0);
+        if (par->extradata_size) {
+            av_bprint_init(&extradata, 0, AV_BPRINT_SIZE_UNLIMITED);
+            for (j = 0; j < par->extradata_size; j++)
+                av_bprintf(&extradata, "%02x", par->extradata[j]);
+            if (av_bprint_is_complete(&extradata))
+                av_dict_set(&d, "extradata", extradata.str, 0);
+            av_bprint_finalize(&extradata, NULL);
+        }
+        snprintf(name, sizeof(name), "stream.%d", i);
+        if (av_dict_get_string(d, &str, '=', ':') >= 0)
+            av_dict_set(&entry, name, str, AV_DICT_DONT_STRDUP_VAL);
+        av_dict_free(&d);
+    }
+
+    if ((ret = av_dict_get_string(entry, &str, '=', '\n')) >= 0) {
+        if ((ret = avio_open(&pb, path, AVIO_FLAG_WRITE)) >= 0) {
+            avio_write(pb, str, strlen(str));
+            ret = avio_closep(&pb);
+        }
+        av_free(str);
+    }
+    if (ret < 0)
+        av_log(NULL, AV_LOG_WARNING, "Could not write probe cache %s\n", path);
+    av_dict_free(&entry);
+    av_free(path);
+}
+
+/* whether the demuxer found all the decoders and the display need, so that
+ * the streams can be opened without decoding anything first */
+static int stream_parameters_known(AVFormatContext *ic)
+{
+    int i;
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVCodecParameters *par = ic->streams[i]->codecpar;
+
+        if (par->codec_id == AV_CODEC_ID_NONE)
+            return 0;
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO &&
+            (!par->width || !par->height || par->format < 0))
+            return 0;
+        if (par->codec_type == AVMEDIA_TYPE_AUDIO &&
+            (!par->sample_rate || !par->channels || par->format < 0))
+            return 0;
+    }
+    return ic->nb_streams > 0;
+}
+
+/* whether the header gave the start time, and the duration when the input can be seeked, which
+ * avformat_find_stream_info() estimates otherwise; the ones derived from the streams are set on ic */
+static int stream_timings_known(AVFormatContext *ic)
+{
+    int64_t start_time = ic->start_time, duration = ic->duration;
+    int i;
+
+    for (i = 0; i < ic->nb_streams; i++) {
+        AVStream *st = ic->streams[i];
+
+        if (ic->start_time == AV_NOPTS_VALUE && st->start_time == AV_NOPTS_VALUE) {
+            if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO || st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO)
+                return 0;
+        } else if (ic->start_time == AV_NOPTS_VALUE) {
+            start_time = FFMIN(start_time == AV_NOPTS_VALUE ? INT64_MAX : start_time,
+                               av_rescale_q(st->start_time, st->time_base, AV_TIME_BASE_Q));
+        }
+        if (ic->duration == AV_NOPTS_VALUE && st->duration != AV_NOPTS_VALUE)
+            duration = FFMAX(duration == AV_NOPTS_VALUE ? 0 : duration,
+                             av_rescale_q(st->duration, st->time_base, AV_TIME_BASE_Q));
+    }
+    if (start_time == AV_NOPTS_VALUE ||
+        (duration == AV_NOPTS_VALUE && ic->pb && (ic->pb->seekable & AVIO_SEEKABLE_NORMAL)))
+        return 0;
+    ic->start_time = start_time;
+    ic->duration   = duration;
+    return 1;
+}
+
+static AltStream *alt_stream_find(VideoState *is, int stream_index)
+{
+    int i;
+
+    for (i = 0; i < is->nb_alt_streams; i++)
+        if (is->alt_streams[i].stream_index == stream_index)
+            return &is->alt_streams[i];
+    return NULL;
+}
+
+/* Open the decoder of a stream not played and start keeping its packets. */
+static int alt_stream_open(VideoState *is, int stream_index)
+{
+    AVFormatContext *ic = is->ic;
+    AVStream *st = ic->streams[stream_index];
+    AltStream *alt = &is->alt_streams[is->nb_alt_streams];
+    const char *forced_codec_name = st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO ? audio_codec_name : subtitle_codec_name;
+    const AVCodec *codec;
+    AVDictionary *opts;
+    int ret;
+
+    codec = forced_codec_name ? avcodec_find_decoder_by_name(forced_codec_name) : avcodec_find_decoder(st->codecpar->codec_id);
+    if (!codec)
+        return AVERROR_DECODER_NOT_FOUND;
+    if (!(alt->avctx = avcodec_alloc_context3(NULL)))
+        return AVERROR(ENOMEM);
+    if ((ret = avcodec_parameters_to_context(alt->avctx, st->codecpar)) < 0)
+        goto fail;
+    alt->avctx->pkt_timebase = st->time_base;
+    alt->avctx->codec_id     = codec->id;
+    if (fast)
+        alt->avctx->flags2 |= AV_CODEC_FLAG2_FAST;
+    opts = filter_codec_opts(codec_opts, codec->id, ic, st, codec);
+    if (!av_dict_get(opts, "threads", NULL, 0))
+        av_dict_set(&opts, "threads", "auto", 0);
+    ret = avcodec_open2(alt->avctx, codec, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        goto fail;
+    if ((ret = packet_queue_init(&alt->q)) < 0) {
+        packet_queue_destroy(&alt->q);
+        goto fail;
+    }
+    packet_queue_start(&alt->q);
+    alt->stream_index = stream_index;
+    st->discard = AVDISCARD_DEFAULT;
+    is->nb_alt_streams++;
+    return 0;
+fail:
+    avcodec_free_context(&alt->avctx);
+    return ret;
+}
+
+static void alt_streams_open(VideoState *is)
+{
+    AVFormatContext *ic = is->ic;
+    AVCodecParameters *par;
+    int i;
+
+    for (i = 0; i < ic->nb_streams && is->nb_alt_streams < MAX_ALT_STREAMS; i++) {
+        par = ic->streams[i]->codecpar;
+        if (i == is->audio_stream || i == is->subtitle_stream)
+            continue;
+        if (!(par->codec_type == AVMEDIA_TYPE_AUDIO && par->sample_rate && par->channels) &&
+            par->codec_type != AVMEDIA_TYPE_SUBTITLE)
+            continue;
+        if (alt_stream_open(is, i) < 0)
+            av_log(NULL, AV_LOG_WARNING, "%s: could not prepare stream #%d for switching\n", is->filename, i);
+    }
+}
+
+static void alt_streams_close(VideoState *is)
+{
+    int i;
+
+    for (i = 0; i < is->nb_alt_streams; i++) {
+        packet_queue_destroy(&is->alt_streams[i].q);
+        avcodec_free_context(&is->alt_streams[i].avctx);
+    }
+    is->nb_alt_streams = 0;
+}
+
+static void alt_stream_put(VideoState *is, AltStream *alt, AVPacket *pkt)
+{
+    AVStream *st = is->ic->streams[alt->stream_index];
+    double clock = get_master_clock(is);
+    int64_t min_ts = AV_NOPTS_VALUE;
+
+    if (!isnan(clock))
+        min_ts = (int64_t)((clock - ALT_QUEUE_BEHIND) / av_q2d(st->time_base));
+    packet_queue_put(&alt->q, pkt);
+    packet_queue_trim(&alt->q, ALT_QUEUE_PACKETS, min_ts);
+}
+
+/* Play an alternate stream in place of the audio or subtitle stream playing, which becomes an alternate
+ * one in turn. The audio output stays open and the packets already demuxed are decoded at once, so
+ * the switch takes about one audio buffer. Called by the read thread, between two packets. */
+static void alt_stream_switch(VideoState *is, AltStream *alt)
+{
+    AVFormatContext *ic = is->ic;
+    int type = alt->avctx->codec_type;
+    Decoder *d = type == AVMEDIA_TYPE_AUDIO ? &is->auddec : &is->subdec;
+    FrameQueue *fq = type == AVMEDIA_TYPE_AUDIO ? &is->sampq : &is->subpq;
+    PacketQueue *q = type == AVMEDIA_TYPE_AUDIO ? &is->audioq : &is->subtitleq;
+    int old_index = type == AVMEDIA_TYPE_AUDIO ? is->audio_stream : is->subtitle_stream;
+    int new_index = alt->stream_index;
+    AVCodecContext *old = NULL;
+    AVPacket *pkt;
+    int64_t start = av_gettime_relative();
+    int nb_packets = 0, ret;
+
+    if (!(pkt = av_packet_alloc()))
+        return;
+    if (old_index >= 0) {
+        decoder_abort(d, fq);
+        old = d->avctx;
+        d->avctx = NULL;
+        decoder_destroy(d);
+        avcodec_flush_buffers(old);
+        ic->streams[old_index]->discard = AVDISCARD_DEFAULT;
+    }
+    if ((ret = decoder_init(d, alt->avctx, q, is->continue_read_thread)) < 0)
+        goto fail;
+
+    if (type == AVMEDIA_TYPE_AUDIO) {
+        is->audio_stream = is->last_audio_stream = new_index;
+        is->audio_st = ic->streams[new_index];
+        is->audio_diff_avg_count = 0;
+        if ((is->ic->iformat->flags & (AVFMT_NOBINSEARCH | AVFMT_NOGENSEARCH | AVFMT_NO_BYTE_SEEK)) && !is->ic->iformat->read_seek) {
+            d->start_pts = is->audio_st->start_time;
+            d->start_pts_tb = is->audio_st->time_base;
+        }
+        ret = decoder_start(d, audio_thread, "audio_decoder", is);
+        /* what the output plays until it gets the new audio */
+        is->audio_skip_until  = get_clock(&is->audclk) + (double)is->audio_hw_buf_size / is->audio_tgt.bytes_per_sec;
+        is->audio_skip_serial = q->serial;
+    } else {
+        is->subtitle_stream = is->last_subtitle_stream = new_index;
+        is->subtitle_st = ic->streams[new_index];
+        ret = decoder_start(d, subtitle_thread, "subtitle_decoder", is);
+    }
+    if (ret < 0)
+        goto fail;
+
+    while (packet_queue_get(&alt->q, pkt, 0, NULL) > 0) {
+        packet_queue_put(q, pkt);
+        nb_packets++;
+    }
+    if (is->eof)
+        packet_queue_put_nullpacket(q, pkt, new_index);
+
+    /* the stream left keeps its decoder, ready for switching back */
+    alt->avctx = old;
+    alt->stream_index = old_index;
+    av_log(NULL, AV_LOG_VERBOSE, "Switched to prepared %s stream #%d with %d packets in %0.3f ms\n",
+           av_get_media_type_string(type), new_index, nb_packets, (av_gettime_relative() - start) / 1000.0);
+    av_packet_free(&pkt);
+    return;
+fail:
+    av_log(NULL, AV_LOG_ERROR, "Could not switch to %s stream #%d\n", av_get_media_type_string(type), new_index);
+    alt->avctx = old;
+    alt->stream_index = old_index;
+    av_packet_free(&pkt);
+}
+
 /* this thread gets the stream from the disk or the network */
 static int read_thread(void *arg)
 {
@@ -2760,10 +5569,15 @@ static int read_thread(void *arg)
     AVPacket *pkt = NULL;
     int64_t stream_start_time;
     int pkt_in_play_range = 0;
+    AltStream *alt;
     AVDictionaryEntry *t;
     SDL_mutex *wait_mutex = SDL_CreateMutex();
     int scan_all_pmts_set = 0;
     int64_t pkt_ts;
+    AVDictionary *probe_cache = NULL;
+    int probe_cache_complete, header_streams;
+    const AVInputFormat *iformat = is->iformat;
+    int auto_select;
 
     if (!wait_mutex) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateMutex(): %s\n", SDL_GetError());
@@ -2788,11 +5602,47 @@ static int read_thread(void *arg)
     }
     ic->interrupt_callback.callback = decode_interrupt_cb;
     ic->interrupt_callback.opaque = is;
+    if (fast_start) {
+        /* -probesize and -analyzeduration given by the user still take precedence */
+        ic->probesize            = FAST_START_PROBESIZE;
+        ic->max_analyze_duration = FAST_START_ANALYZE_DURATION;
+    }
+    if (is->live)
+        ic->flags |= AVFMT_FLAG_NOBUFFER;
     if (!av_dict_get(format_opts, "scan_all_pmts", NULL, AV_DICT_MATCH_CASE)) {
         av_dict_set(&format_opts, "scan_all_pmts", "1", AV_DICT_DONT_OVERWRITE);
         scan_all_pmts_set = 1;
     }
-    err = avformat_open_input(&ic, is->filename, is->iformat, &format_opts);
+    if (probe_cache_dir && (probe_cache = probe_cache_load(is->filename)) && !iformat) {
+        AVDictionaryEntry *e = av_dict_get(probe_cache, "format", NULL, AV_DICT_MATCH_CASE);
+        if (e)
+            iformat = av_find_input_format(e->value);
+    }
+    if (mmap_input) {
+        if ((err = mapped_file_open(&is->mapped_pb, is->filename)) >= 0) {
+            ic->pb     = is->mapped_pb;
+            ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+            av_log(NULL, AV_LOG_VERBOSE, "%s: reading through a memory mapping\n", is->filename);
+        } else if (err != AVERROR(ENOTSUP)) {
+            char errbuf[128];
+            av_strerror(err, errbuf, sizeof(errbuf));
+            av_log(NULL, AV_LOG_VERBOSE, "%s: could not map file, using default I/O: %s\n",
+                   is->filename, errbuf);
+        }
+    }
+    if (!is->mapped_pb && read_ahead_mb > 0 && !(is->iformat && is->iformat->flags & AVFMT_NOFILE)) {
+        if ((err = read_ahead_open(&is->read_ahead_pb, is->filename, read_ahead_mb,
+                                   &ic->interrupt_callback, &format_opts)) < 0) {
+            print_error(is->filename, err);
+            ret = -1;
+            goto fail;
+        }
+        ic->pb     = is->read_ahead_pb;
+        ic->flags |= AVFMT_FLAG_CUSTOM_IO;
+    }
+    startup_mark(STARTUP_OPEN_INPUT, 0);
+    err = avformat_open_input(&ic, is->filename, iformat, &format_opts);
+    startup_mark(STARTUP_OPEN_INPUT, 1);
     if (err < 0) {
         print_error(is->filename, err);
         ret = -1;
@@ -2813,11 +5663,20 @@ static int read_thread(void *arg)
 
     av_format_inject_global_side_data(ic);
 
-    if (find_stream_info) {
+    header_streams = ic->nb_streams;
+    if (probe_cache && (err = probe_cache_apply(ic, probe_cache)) < 0) {
+        av_log(NULL, AV_LOG_VERBOSE, "%s: cached probing results do not match, probing again\n", is->filename);
+        av_dict_free(&probe_cache);
+    }
+    probe_cache_complete = probe_cache && !err;
+
+    if (find_stream_info && !probe_cache_complete && !(fast_start && stream_parameters_known(ic) && stream_timings_known(ic))) {
         AVDictionary **opts = setup_find_stream_info_opts(ic, codec_opts);
         int orig_nb_streams = ic->nb_streams;
 
+        startup_mark(STARTUP_PROBE, 0);
         err = avformat_find_stream_info(ic, opts);
+        startup_mark(STARTUP_PROBE, 1);
 
         for (i = 0; i < orig_nb_streams; i++)
             av_dict_free(&opts[i]);
@@ -2834,12 +5693,13 @@ static int read_thread(void *arg)
     if (ic->pb)
         ic->pb->eof_reached = 0; // FIXME hack, ffplay maybe should not use avio_feof() to test for the end
 
-    if (seek_by_bytes < 0)
-        seek_by_bytes = !!(ic->iformat->flags & AVFMT_TS_DISCONT) && strcmp("ogg", ic->iformat->name);
+    is->seek_by_bytes = seek_by_bytes;
+    if (is->seek_by_bytes < 0)
+        is->seek_by_bytes = !!(ic->iformat->flags & AVFMT_TS_DISCONT) && strcmp("ogg", ic->iformat->name);
 
     is->max_frame_duration = (ic->iformat->flags & AVFMT_TS_DISCONT) ? 10.0 : 3600.0;
 
-    if (!window_title && (t = av_dict_get(ic->metadata, "title", NULL, 0)))
+    if (!window_title && !is->instance && nb_input_files == 1 && (t = av_dict_get(ic->metadata, "title", NULL, 0)))
         window_title = av_asprintf("%s - %s", t->value, input_filename);
 
     /* if seeking requested, we execute it */
@@ -2877,43 +5737,69 @@ static int read_thread(void *arg)
         }
     }
 
-    if (!video_disable)
-        st_index[AVMEDIA_TYPE_VIDEO] =
-            av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO,
-                                st_index[AVMEDIA_TYPE_VIDEO], -1, NULL, 0);
-    if (!audio_disable)
-        st_index[AVMEDIA_TYPE_AUDIO] =
-            av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO,
-                                st_index[AVMEDIA_TYPE_AUDIO],
-                                st_index[AVMEDIA_TYPE_VIDEO],
-                                NULL, 0);
-    if (!video_disable && !subtitle_disable)
-        st_index[AVMEDIA_TYPE_SUBTITLE] =
-            av_find_best_stream(ic, AVMEDIA_TYPE_SUBTITLE,
-                                st_index[AVMEDIA_TYPE_SUBTITLE],
-                                (st_index[AVMEDIA_TYPE_AUDIO] >= 0 ?
-                                 st_index[AVMEDIA_TYPE_AUDIO] :
-                                 st_index[AVMEDIA_TYPE_VIDEO]),
-                                NULL, 0);
+    /* the cached choice is only valid for the default selection */
+    auto_select = !video_disable && !audio_disable && !subtitle_disable &&
+                  !wanted_stream_spec[AVMEDIA_TYPE_VIDEO] && !wanted_stream_spec[AVMEDIA_TYPE_AUDIO] &&
+                  !wanted_stream_spec[AVMEDIA_TYPE_SUBTITLE];
+    if (auto_select && av_dict_get(probe_cache, "video", NULL, AV_DICT_MATCH_CASE)) {
+        st_index[AVMEDIA_TYPE_VIDEO]    = probe_cache_get_int(probe_cache, "video", -1);
+        st_index[AVMEDIA_TYPE_AUDIO]    = probe_cache_get_int(probe_cache, "audio", -1);
+        st_index[AVMEDIA_TYPE_SUBTITLE] = probe_cache_get_int(probe_cache, "subtitle", -1);
+        for (i = 0; i < AVMEDIA_TYPE_NB; i++)
+            if (st_index[i] >= (int)ic->nb_streams || (st_index[i] >= 0 && ic->streams[st_index[i]]->codecpar->codec_type != i))
+                st_index[i] = -1;
+    } else {
+        if (!video_disable)
+            st_index[AVMEDIA_TYPE_VIDEO] =
+                av_find_best_stream(ic, AVMEDIA_TYPE_VIDEO,
+                                    st_index[AVMEDIA_TYPE_VIDEO], -1, NULL, 0);
+        if (!audio_disable)
+            st_index[AVMEDIA_TYPE_AUDIO] =
+                av_find_best_stream(ic, AVMEDIA_TYPE_AUDIO,
+                                    st_index[AVMEDIA_TYPE_AUDIO],
+                                    st_index[AVMEDIA_TYPE_VIDEO],
+                                    NULL, 0);
+        if (!video_disable && !subtitle_disable)
+            st_index[AVMEDIA_TYPE_SUBTITLE] =
+                av_find_best_stream(ic, AVMEDIA_TYPE_SUBTITLE,
+                                    st_index[AVMEDIA_TYPE_SUBTITLE],
+                                    (st_index[AVMEDIA_TYPE_AUDIO] >= 0 ?
+                                     st_index[AVMEDIA_TYPE_AUDIO] :
+                                     st_index[AVMEDIA_TYPE_VIDEO]),
+                                    NULL, 0);
+    }
+    if (probe_cache_dir && !probe_cache)
+        probe_cache_store(is->filename, ic, header_streams, auto_select ? st_index : NULL);
+    av_dict_free(&probe_cache);
 
     is->show_mode = show_mode;
     if (st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
         AVStream *st = ic->streams[st_index[AVMEDIA_TYPE_VIDEO]];
         AVCodecParameters *codecpar = st->codecpar;
         AVRational sar = av_guess_sample_aspect_ratio(ic, st, NULL);
-        if (codecpar->width)
+        if (codecpar->width && !is->instance)
             set_default_window_size(codecpar->width, codecpar->height, sar);
     }
 
-    /* open the streams */
     if (st_index[AVMEDIA_TYPE_AUDIO] >= 0) {
-        stream_component_open(is, st_index[AVMEDIA_TYPE_AUDIO]);
+        AVCodecParameters *codecpar = ic->streams[st_index[AVMEDIA_TYPE_AUDIO]]->codecpar;
+        audio_prepare_request(codecpar->channel_layout, codecpar->channels, codecpar->sample_rate);
+    } else {
+        audio_prepare_request(0, 0, 0);
     }
 
+    /* open the streams, the video first so that its decoder opens while the audio device is prepared */
+    startup_mark(STARTUP_OPEN_STREAMS, 0);
     ret = -1;
     if (st_index[AVMEDIA_TYPE_VIDEO] >= 0) {
+        /* the video filters are set up for the texture formats of the renderer */
+        startup_wait(STARTUP_RENDERER);
         ret = stream_component_open(is, st_index[AVMEDIA_TYPE_VIDEO]);
     }
+
+    if (st_index[AVMEDIA_TYPE_AUDIO] >= 0) {
+        stream_component_open(is, st_index[AVMEDIA_TYPE_AUDIO]);
+    }
     if (is->show_mode == SHOW_MODE_NONE)
         is->show_mode = ret >= 0 ? SHOW_MODE_VIDEO : SHOW_MODE_RDFT;
 
@@ -2927,8 +5813,12 @@ static int read_thread(void *arg)
         ret = -1;
         goto fail;
     }
+    if (prewarm)
+        alt_streams_open(is);
+    startup_mark(STARTUP_OPEN_STREAMS, 1);
+    is->preroll_done = 1;
 
-    if (infinite_buffer < 0 && is->realtime)
+    if (infinite_buffer < 0 && (is->realtime || is->live))
         infinite_buffer = 1;
 
     for (;;) {
@@ -2944,7 +5834,7 @@ static int read_thread(void *arg)
 #if CONFIG_RTSP_DEMUXER || CONFIG_MMSH_PROTOCOL
         if (is->paused &&
                 (!strcmp(ic->iformat->name, "rtsp") ||
-                 (ic->pb && !strncmp(input_filename, "mmsh:", 5)))) {
+                 (ic->pb && !strncmp(is->filename, "mmsh:", 5)))) {
             /* wait 10 ms to avoid trying to get another packet */
             /* XXX: horrible */
             SDL_Delay(10);
@@ -2969,6 +5859,8 @@ static int read_thread(void *arg)
                     packet_queue_flush(&is->subtitleq);
                 if (is->video_stream >= 0)
                     packet_queue_flush(&is->videoq);
+                for (i = 0; i < is->nb_alt_streams; i++)
+                    packet_queue_flush(&is->alt_streams[i].q);
                 if (is->seek_flags & AVSEEK_FLAG_BYTE) {
                    set_clock(&is->extclk, NAN, 0);
                 } else {
@@ -2981,6 +5873,12 @@ static int read_thread(void *arg)
             if (is->paused)
                 step_to_next_frame(is);
         }
+        if (is->switch_req) {
+            AltStream *alt = alt_stream_find(is, is->switch_stream);
+            if (alt)
+                alt_stream_switch(is, alt);
+            is->switch_req = 0;
+        }
         if (is->queue_attachments_req) {
             if (is->video_st && is->video_st->disposition & AV_DISPOSITION_ATTACHED_PIC) {
                 if ((ret = av_packet_ref(pkt, &is->video_st->attached_pic)) < 0)
@@ -3003,7 +5901,7 @@ static int read_thread(void *arg)
             SDL_UnlockMutex(wait_mutex);
             continue;
         }
-        if (!is->paused &&
+        if (!is->paused && !playlist &&
             (!is->audio_st || (is->auddec.finished == is->audioq.serial && frame_queue_nb_remaining(&is->sampq) == 0)) &&
             (!is->video_st || (is->viddec.finished == is->videoq.serial && frame_queue_nb_remaining(&is->pictq) == 0))) {
             if (loop != 1 && (!loop || --loop)) {
@@ -3013,7 +5911,13 @@ static int read_thread(void *arg)
                 goto fail;
             }
         }
-        ret = av_read_frame(ic, pkt);
+        if (benchmark) {
+            int64_t demux_start = av_gettime_relative();
+            ret = av_read_frame(ic, pkt);
+            is->demux_time += av_gettime_relative() - demux_start;
+            is->demux_count++;
+        } else
+            ret = av_read_frame(ic, pkt);
         if (ret < 0) {
             if ((ret == AVERROR_EOF || avio_feof(ic->pb)) && !is->eof) {
                 if (is->video_stream >= 0)
@@ -3045,6 +5949,10 @@ static int read_thread(void *arg)
                 av_q2d(ic->streams[pkt->stream_index]->time_base) -
                 (double)(start_time != AV_NOPTS_VALUE ? start_time : 0) / 1000000
                 <= ((double)duration / 1000000);
+        if (is->live && pkt_in_play_range) {
+            live_packet_arrived(is, pkt);
+            live_drain_queues(is, pkt);
+        }
         if (pkt->stream_index == is->audio_stream && pkt_in_play_range) {
             packet_queue_put(&is->audioq, pkt);
         } else if (pkt->stream_index == is->video_stream && pkt_in_play_range
@@ -3052,6 +5960,8 @@ static int read_thread(void *arg)
             packet_queue_put(&is->videoq, pkt);
         } else if (pkt->stream_index == is->subtitle_stream && pkt_in_play_range) {
             packet_queue_put(&is->subtitleq, pkt);
+        } else if (pkt_in_play_range && (alt = alt_stream_find(is, pkt->stream_index))) {
+            alt_stream_put(is, alt, pkt);
         } else {
             av_packet_unref(pkt);
         }
@@ -3061,11 +5971,14 @@ static int read_thread(void *arg)
  fail:
     if (ic && !is->ic)
         avformat_close_input(&ic);
+    av_dict_free(&probe_cache);
 
     av_packet_free(&pkt);
     if (ret != 0) {
         SDL_Event event;
 
+        /* the input is opened while SDL is initialized, its events only from then on */
+        startup_wait(STARTUP_SDL);
         event.type = FF_QUIT_EVENT;
         event.user.data1 = is;
         SDL_PushEvent(&event);
@@ -3075,16 +5988,19 @@ static int read_thread(void *arg)
 }
 
 static VideoState *stream_open(const char *filename,
-                               const AVInputFormat *iformat)
+                               const AVInputFormat *iformat, VideoState *preceding)
 {
     VideoState *is;
 
     is = av_mallocz(sizeof(VideoState));
     if (!is)
         return NULL;
+    is->instance = preceding ? preceding->instance : nb_streams;
+    is->preceding = preceding;
     is->last_video_stream = is->video_stream = -1;
     is->last_audio_stream = is->audio_stream = -1;
     is->last_subtitle_stream = is->subtitle_stream = -1;
+    is->open_time = av_gettime_relative();
     is->filename = av_strdup(filename);
     if (!is->filename)
         goto fail;
@@ -3093,8 +6009,9 @@ static VideoState *stream_open(const char *filename,
     is->xleft   = 0;
 
     /* start video display */
-    if (frame_queue_init(&is->pictq, &is->videoq, VIDEO_PICTURE_QUEUE_SIZE, 1) < 0)
+    if (frame_queue_init(&is->pictq, &is->videoq, adaptive_pictq ? FRAME_QUEUE_SIZE : VIDEO_PICTURE_QUEUE_SIZE, 1) < 0)
         goto fail;
+    is->pictq.depth = is->pictq_depth_min = is->pictq_depth_max = VIDEO_PICTURE_QUEUE_SIZE;
     if (frame_queue_init(&is->subpq, &is->subtitleq, SUBPICTURE_QUEUE_SIZE, 0) < 0)
         goto fail;
     if (frame_queue_init(&is->sampq, &is->audioq, SAMPLE_QUEUE_SIZE, 1) < 0)
@@ -3104,6 +6021,11 @@ static VideoState *stream_open(const char *filename,
         packet_queue_init(&is->audioq) < 0 ||
         packet_queue_init(&is->subtitleq) < 0)
         goto fail;
+    if (packet_arena) {
+        is->videoq.arena_size    = VIDEO_PACKET_ARENA_SIZE;
+        is->audioq.arena_size    = AUDIO_PACKET_ARENA_SIZE;
+        is->subtitleq.arena_size = SUBTITLE_PACKET_ARENA_SIZE;
+    }
 
     if (!(is->continue_read_thread = SDL_CreateCond())) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateCond(): %s\n", SDL_GetError());
@@ -3123,6 +6045,16 @@ static VideoState *stream_open(const char *filename,
     is->audio_volume = startup_volume;
     is->muted = 0;
     is->av_sync_type = av_sync_type;
+    if (cadence && is->av_sync_type == AV_SYNC_AUDIO_MASTER) {
+        /* the video keeps the cadence of the display, the audio is resampled to follow it */
+        is->av_sync_type = AV_SYNC_VIDEO_MASTER;
+    }
+    if (live_mode) {
+        /* live inputs are played at the pace they arrive */
+        is->live = 1;
+        is->live_delay = LIVE_INITIAL_DELAY;
+        is->av_sync_type = AV_SYNC_EXTERNAL_CLOCK;
+    }
     is->read_tid     = SDL_CreateThread(read_thread, "read_thread", is);
     if (!is->read_tid) {
         av_log(NULL, AV_LOG_FATAL, "SDL_CreateThread(): %s\n", SDL_GetError());
@@ -3142,6 +6074,10 @@ static void stream_cycle_channel(VideoState *is, int codec_type)
     AVProgram *p = NULL;
     int nb_streams = is->ic->nb_streams;
 
+    /* the next playlist item may be taking over the audio output */
+    if (codec_type == AVMEDIA_TYPE_AUDIO && playlist_next && !playlist_next->preroll_done)
+        return;
+
     if (codec_type == AVMEDIA_TYPE_VIDEO) {
         start_index = is->last_video_stream;
         old_index = is->video_stream;
@@ -3207,6 +6143,14 @@ static void stream_cycle_channel(VideoState *is, int codec_type)
            old_index,
            stream_index);
 
+    /* a prepared stream is switched to by the read thread */
+    if (codec_type != AVMEDIA_TYPE_VIDEO && stream_index >= 0 && alt_stream_find(is, stream_index) &&
+        (old_index >= 0 || codec_type == AVMEDIA_TYPE_SUBTITLE)) {
+        is->switch_stream = stream_index;
+        is->switch_req = 1;
+        SDL_CondSignal(is->continue_read_thread);
+        return;
+    }
     stream_component_close(is, old_index);
     stream_component_open(is, stream_index);
 }
@@ -3227,11 +6171,102 @@ static void toggle_audio_display(VideoState *is)
     if (is->show_mode != next) {
         is->force_refresh = 1;
         is->show_mode = next;
+        if (next == SHOW_MODE_VIDEO)
+            sample_array_free(is);
+    }
+}
+
+/* index of the playlist item after the given one, or -1 at the end */
+static int playlist_following(int index)
+{
+    if (index + 1 < nb_input_files)
+        return index + 1;
+    if (loop != 1 && (!loop || --loop))
+        return 0;
+    return -1;
+}
+
+/* whether the current playlist item played everything */
+static int playlist_item_finished(VideoState *is)
+{
+    int handed_over, waiting;
+
+    if (is->playlist_done)
+        return 1;
+    if (is->paused)
+        return 0;
+    if (is->audio_st && is->audio_out) {
+        SDL_LockAudioDevice(is->audio_dev);
+        handed_over = is->audio_out->is != is;
+        waiting = !!is->audio_successor;
+        SDL_UnlockAudioDevice(is->audio_dev);
+        if (waiting || (!handed_over &&
+            (is->auddec.finished != is->audioq.serial || frame_queue_nb_remaining(&is->sampq))))
+            return 0;
+    }
+    if (is->video_st) {
+        if (is->viddec.finished != is->videoq.serial || frame_queue_nb_remaining(&is->pictq))
+            return 0;
+        if (is->pictq.rindex_shown &&
+            av_gettime_relative() / 1000000.0 < is->frame_timer + frame_queue_peek_last(&is->pictq)->duration)
+            return 0;
     }
+    return 1;
 }
 
-static void refresh_loop_wait_event(VideoState *is, SDL_Event *event) {
+/* Open and pre-roll the next playlist item once the current one plays, and put it in place of the
+ * current one when that one is finished. The audio device, the tile and the textures go on with
+ * the next item, whose queues are already filled. */
+static void playlist_update(void)
+{
+    VideoState *is = streams[0], *next;
+    int index;
+
+    if (!playlist_next && !playlist_ended &&
+        (is->audio_callback_time || is->first_frame_time || is->playlist_done)) {
+        if ((index = playlist_following(playlist_next_index)) < 0) {
+            playlist_ended = 1;
+        } else {
+            playlist_next_index = index;
+            playlist_next = stream_open(input_filenames[index], file_iformat, is);
+            if (!playlist_next)
+                av_log(NULL, AV_LOG_ERROR, "Failed to open playlist item %s\n", input_filenames[index]);
+        }
+    }
+    if (!playlist_item_finished(is))
+        return;
+    if (!playlist_next) {
+        if (playlist_ended && (autoexit || is->playlist_done))
+            do_exit();
+        return;
+    }
+    if (!playlist_next->preroll_done)
+        return;
+
+    next = playlist_next;
+    playlist_next = NULL;
+    playlist_index = playlist_next_index;
+    av_log(NULL, AV_LOG_VERBOSE, "Playlist item %d: %s\n", playlist_index, next->filename);
+
+    next->preceding = NULL;
+    next->audio_volume = is->audio_volume;
+    next->muted  = is->muted;
+    next->xleft  = is->xleft;
+    next->ytop   = is->ytop;
+    next->width  = is->width;
+    next->height = is->height;
+    FFSWAP(SDL_Texture *, next->vid_texture, is->vid_texture);
+    FFSWAP(SDL_Texture *, next->vis_texture, is->vis_texture);
+    streams[0] = next;
+    stream_close(is);
+    if (next->audio_out && !next->audio_handed_over)
+        SDL_PauseAudioDevice(next->audio_dev, 0);
+    next->force_refresh = 1;
+}
+
+static void refresh_loop_wait_event(SDL_Event *event) {
     double remaining_time = 0.0;
+    int i;
     SDL_PumpEvents();
     while (!SDL_PeepEvents(event, 1, SDL_GETEVENT, SDL_FIRSTEVENT, SDL_LASTEVENT)) {
         if (!cursor_hidden && av_gettime_relative() - cursor_last_shown > CURSOR_HIDE_DELAY) {
@@ -3241,8 +6276,15 @@ static void refresh_loop_wait_event(VideoState *is, SDL_Event *event) {
         if (remaining_time > 0.0)
             av_usleep((int64_t)(remaining_time * 1000000.0));
         remaining_time = REFRESH_RATE;
-        if (is->show_mode != SHOW_MODE_NONE && (!is->paused || is->force_refresh))
-            video_refresh(is, &remaining_time);
+        if (playlist)
+            playlist_update();
+        for (i = 0; i < nb_streams; i++) {
+            VideoState *is = streams[i];
+            if (is->show_mode != SHOW_MODE_NONE && (!is->paused || is->force_refresh))
+                video_refresh(is, &remaining_time);
+        }
+        if (display_pending)
+            display_streams();
         SDL_PumpEvents();
     }
 }
@@ -3274,19 +6316,33 @@ static void seek_chapter(VideoState *is, int incr)
                                  AV_TIME_BASE_Q), 0, 0);
 }
 
+/* the instance shown at a window position */
+static int stream_at(int x, int y)
+{
+    int i;
+    for (i = 0; i < nb_streams; i++)
+        if (x >= streams[i]->xleft && x < streams[i]->xleft + streams[i]->width &&
+            y >= streams[i]->ytop  && y < streams[i]->ytop  + streams[i]->height)
+            return i;
+    return focused_stream;
+}
+
 /* handle an event sent by the GUI */
-static void event_loop(VideoState *cur_stream)
+static void event_loop(void)
 {
     SDL_Event event;
     double incr, pos, frac;
+    VideoState *cur_stream;
+    int i;
 
     for (;;) {
         double x;
-        refresh_loop_wait_event(cur_stream, &event);
+        refresh_loop_wait_event(&event);
+        cur_stream = streams[focused_stream];
         switch (event.type) {
         case SDL_KEYDOWN:
             if (exit_on_keydown || event.key.keysym.sym == SDLK_ESCAPE || event.key.keysym.sym == SDLK_q) {
-                do_exit(cur_stream);
+                do_exit();
                 break;
             }
             // If we don't yet have a window, skip all key events, because read_thread might still be initializing...
@@ -3368,7 +6424,7 @@ static void event_loop(VideoState *cur_stream)
             case SDLK_DOWN:
                 incr = -60.0;
             do_seek:
-                    if (seek_by_bytes) {
+                    if (cur_stream->seek_by_bytes) {
                         pos = -1;
                         if (pos < 0 && cur_stream->video_stream >= 0)
                             pos = frame_queue_last_pos(&cur_stream->pictq);
@@ -3398,9 +6454,11 @@ static void event_loop(VideoState *cur_stream)
             break;
         case SDL_MOUSEBUTTONDOWN:
             if (exit_on_mousedown) {
-                do_exit(cur_stream);
+                do_exit();
                 break;
             }
+            focused_stream = stream_at(event.button.x, event.button.y);
+            cur_stream = streams[focused_stream];
             if (event.button.button == SDL_BUTTON_LEFT) {
                 static int64_t last_mouse_left_click = 0;
                 if (av_gettime_relative() - last_mouse_left_click <= 500000) {
@@ -3420,13 +6478,14 @@ static void event_loop(VideoState *cur_stream)
             if (event.type == SDL_MOUSEBUTTONDOWN) {
                 if (event.button.button != SDL_BUTTON_RIGHT)
                     break;
-                x = event.button.x;
+                x = event.button.x - cur_stream->xleft;
             } else {
                 if (!(event.motion.state & SDL_BUTTON_RMASK))
                     break;
-                x = event.motion.x;
+                x = event.motion.x - cur_stream->xleft;
             }
-                if (seek_by_bytes || cur_stream->ic->duration <= 0) {
+            x = av_clipd(x, 0, cur_stream->width);
+                if (cur_stream->seek_by_bytes || cur_stream->ic->duration <= 0) {
                     uint64_t size =  avio_size(cur_stream->ic->pb);
                     stream_seek(cur_stream, size*x/cur_stream->width, 0, 1);
                 } else {
@@ -3454,19 +6513,19 @@ static void event_loop(VideoState *cur_stream)
         case SDL_WINDOWEVENT:
             switch (event.window.event) {
                 case SDL_WINDOWEVENT_SIZE_CHANGED:
-                    screen_width  = cur_stream->width  = event.window.data1;
-                    screen_height = cur_stream->height = event.window.data2;
-                    if (cur_stream->vis_texture) {
-                        SDL_DestroyTexture(cur_stream->vis_texture);
-                        cur_stream->vis_texture = NULL;
-                    }
+                    screen_width  = event.window.data1;
+                    screen_height = event.window.data2;
+                    layout_streams(screen_width, screen_height);
                 case SDL_WINDOWEVENT_EXPOSED:
-                    cur_stream->force_refresh = 1;
+                    for (i = 0; i < nb_streams; i++)
+                        streams[i]->force_refresh = 1;
             }
             break;
         case SDL_QUIT:
+            do_exit();
+            break;
         case FF_QUIT_EVENT:
-            do_exit(cur_stream);
+            stream_remove(event.user.data1);
             break;
         default:
             break;
@@ -3544,17 +6603,47 @@ static int opt_show_mode(void *optctx, const char *opt, const char *arg)
     return 0;
 }
 
+static int opt_layout(void *optctx, const char *opt, const char *arg)
+{
+    if (!strcmp(arg, "grid"))
+        window_layout = LAYOUT_GRID;
+    else if (!strcmp(arg, "mosaic"))
+        window_layout = LAYOUT_MOSAIC;
+    else {
+        av_log(NULL, AV_LOG_ERROR, "Unknown value for %s: %s\n", opt, arg);
+        exit(1);
+    }
+    return 0;
+}
+
+static int opt_decode_policy(void *optctx, const char *opt, const char *arg)
+{
+    if (!strcmp(arg, "auto"))
+        decode_policy = DECODE_POLICY_AUTO;
+    else if (!strcmp(arg, "latency"))
+        decode_policy = DECODE_POLICY_LATENCY;
+    else if (!strcmp(arg, "throughput"))
+        decode_policy = DECODE_POLICY_THROUGHPUT;
+    else {
+        av_log(NULL, AV_LOG_ERROR, "Unknown value for %s: %s\n", opt, arg);
+        exit(1);
+    }
+    return 0;
+}
+
 static void opt_input_file(void *optctx, const char *filename)
 {
-    if (input_filename) {
+    if (nb_input_files == MAX_INPUTS) {
         av_log(NULL, AV_LOG_FATAL,
-               "Argument '%s' provided as input filename, but '%s' was already specified.\n",
-                filename, input_filename);
+               "Argument '%s' provided as input filename, but %d inputs were already specified.\n",
+                filename, MAX_INPUTS);
         exit(1);
     }
     if (!strcmp(filename, "-"))
         filename = "pipe:";
-    input_filename = filename;
+    if (!input_filename)
+        input_filename = filename;
+    input_filenames[nb_input_files++] = filename;
 }
 
 static int opt_codec(void *optctx, const char *opt, const char *arg)
@@ -3608,12 +6697,22 @@ static const OptionDef options[] = {
     { "genpts", OPT_BOOL | OPT_EXPERT, { &genpts }, "generate pts", "" },
     { "drp", OPT_INT | HAS_ARG | OPT_EXPERT, { &decoder_reorder_pts }, "let decoder reorder pts 0=off 1=on -1=auto", ""},
     { "lowres", OPT_INT | HAS_ARG | OPT_EXPERT, { &lowres }, "", "" },
+    { "cadence", OPT_BOOL | OPT_EXPERT, { &cadence }, "present pictures on the display refresh with a regular cadence", "" },
+    { "prewarm", OPT_BOOL | OPT_EXPERT, { &prewarm }, "keep the other audio and subtitle tracks ready for switching", "" },
+    { "adaptive_pictq", OPT_BOOL | OPT_EXPERT, { &adaptive_pictq }, "size the picture queue from the decoding time variations", "" },
+    { "pictq_budget", OPT_INT | HAS_ARG | OPT_EXPERT, { &pictq_budget }, "memory the picture queue may take", "MiB" },
+    { "packetarena", OPT_BOOL | OPT_EXPERT, { &packet_arena }, "queue demuxed payloads in a ring per stream", "" },
+    { "framepool", OPT_BOOL | OPT_EXPERT, { &frame_pool }, "decode video into pooled, 64-byte aligned buffers", "" },
+    { "hugepages", OPT_BOOL | OPT_EXPERT, { &huge_pages }, "back pooled video buffers with huge pages where the system allows", "" },
+    { "decode_policy", HAS_ARG | OPT_EXPERT, { .func_arg = opt_decode_policy }, "how video decoders use threads", "auto|latency|throughput" },
+    { "autolowres", OPT_BOOL | OPT_EXPERT, { &auto_lowres }, "decode or scale down video shown smaller than its size, following the window size", "" },
     { "sync", HAS_ARG | OPT_EXPERT, { .func_arg = opt_sync }, "set audio-video sync. type (type=audio/video/ext)", "type" },
     { "autoexit", OPT_BOOL | OPT_EXPERT, { &autoexit }, "exit at the end", "" },
     { "exitonkeydown", OPT_BOOL | OPT_EXPERT, { &exit_on_keydown }, "exit on key down", "" },
     { "exitonmousedown", OPT_BOOL | OPT_EXPERT, { &exit_on_mousedown }, "exit on mouse down", "" },
     { "loop", OPT_INT | HAS_ARG | OPT_EXPERT, { &loop }, "set number of times the playback shall be looped", "loop count" },
     { "framedrop", OPT_BOOL | OPT_EXPERT, { &framedrop }, "drop frames when cpu is too slow", "" },
+    { "catchup", OPT_BOOL | OPT_EXPERT, { &catch_up }, "skip decoding work of late video, non-reference frames first, when dropping frames", "" },
     { "infbuf", OPT_BOOL | OPT_EXPERT, { &infinite_buffer }, "don't limit the input buffer size (useful with realtime streams)", "" },
     { "window_title", OPT_STRING | HAS_ARG, { &window_title }, "set window title", "window title" },
     { "left", OPT_INT | HAS_ARG | OPT_EXPERT, { &screen_left }, "set the x position for the left of the window", "x pos" },
@@ -3634,6 +6733,15 @@ static const OptionDef options[] = {
     { "find_stream_info", OPT_BOOL | OPT_INPUT | OPT_EXPERT, { &find_stream_info },
         "read and decode the streams to fill missing information with heuristics" },
     { "filter_threads", HAS_ARG | OPT_INT | OPT_EXPERT, { &filter_nbthreads }, "number of filter threads per graph" },
+    { "benchmark", OPT_BOOL | OPT_EXPERT, { &benchmark }, "print timings and counters of the playback pipeline on exit", "" },
+    { "batchwaves", OPT_BOOL | OPT_EXPERT, { &batch_waves }, "draw the waves display with one call per colour, -nobatchwaves draws rectangles one by one", "" },
+    { "mmap", OPT_BOOL | OPT_EXPERT, { &mmap_input }, "read local files through a memory mapping", "" },
+    { "readahead", OPT_INT | HAS_ARG | OPT_EXPERT, { &read_ahead_mb }, "read the input this many megabytes ahead of the demuxer in a separate thread", "megabytes" },
+    { "live", OPT_BOOL | OPT_EXPERT, { &live_mode }, "play a live input with as little latency as its arrival jitter allows", "" },
+    { "faststart", OPT_BOOL | OPT_EXPERT, { &fast_start }, "bound input probing, and skip it when the demuxer already knows the stream parameters and timings", "" },
+    { "layout", HAS_ARG | OPT_EXPERT, { .func_arg = opt_layout }, "how several inputs share the window", "grid|mosaic" },
+    { "playlist", OPT_BOOL | OPT_EXPERT, { &playlist }, "play the inputs one after another without gaps, instead of side by side", "" },
+    { "probecache", OPT_STRING | HAS_ARG | OPT_EXPERT, { &probe_cache_dir }, "keep the probing results of local files in this directory and reopen them without probing", "directory" },
     { NULL, },
 };
 
@@ -3682,7 +6790,7 @@ void show_help_default(const char *opt, const char *arg)
 /* Called from the main */
 int main(int argc, char **argv)
 {
-    int flags;
+    int flags, i;
     VideoState *is;
 
     init_dynload();
@@ -3714,6 +6822,23 @@ int main(int argc, char **argv)
     if (display_disable) {
         video_disable = 1;
     }
+
+    startup.origin = av_gettime_relative();
+    if (!(startup.mutex = SDL_CreateMutex()) || !(startup.cond = SDL_CreateCond())) {
+        av_log(NULL, AV_LOG_FATAL, "Could not create startup synchronization - %s\n", SDL_GetError());
+        exit(1);
+    }
+
+    /* the inputs are opened and probed while SDL, the window and the audio device come up */
+    for (i = 0; i < (playlist ? 1 : nb_input_files); i++) {
+        is = stream_open(input_filenames[i], file_iformat, NULL);
+        if (!is) {
+            av_log(NULL, AV_LOG_FATAL, "Failed to initialize VideoState!\n");
+            do_exit();
+        }
+        streams[nb_streams++] = is;
+    }
+
     flags = SDL_INIT_VIDEO | SDL_INIT_AUDIO | SDL_INIT_TIMER;
     if (audio_disable)
         flags &= ~SDL_INIT_AUDIO;
@@ -3725,17 +6850,22 @@ int main(int argc, char **argv)
     }
     if (display_disable)
         flags &= ~SDL_INIT_VIDEO;
+    startup_mark(STARTUP_SDL, 0);
     if (SDL_Init (flags)) {
         av_log(NULL, AV_LOG_FATAL, "Could not initialize SDL - %s\n", SDL_GetError());
         av_log(NULL, AV_LOG_FATAL, "(Did you set the DISPLAY variable?)\n");
         exit(1);
     }
+    if (!audio_disable && !(startup.audio_tid = SDL_CreateThread(audio_prepare_thread, "audio_prepare", NULL)))
+        av_log(NULL, AV_LOG_WARNING, "SDL_CreateThread(): %s\n", SDL_GetError());
+    startup_mark(STARTUP_SDL, 1);
 
     SDL_EventState(SDL_SYSWMEVENT, SDL_IGNORE);
     SDL_EventState(SDL_USEREVENT, SDL_IGNORE);
 
     if (!display_disable) {
         int flags = SDL_WINDOW_HIDDEN;
+        startup_mark(STARTUP_RENDERER, 0);
         if (alwaysontop)
 #if SDL_VERSION_ATLEAST(2,0,5)
             flags |= SDL_WINDOW_ALWAYS_ON_TOP;
@@ -3759,19 +6889,16 @@ int main(int argc, char **argv)
                     av_log(NULL, AV_LOG_VERBOSE, "Initialized %s renderer.\n", renderer_info.name);
             }
         }
+        startup_mark(STARTUP_RENDERER, 1);
         if (!window || !renderer || !renderer_info.num_texture_formats) {
             av_log(NULL, AV_LOG_FATAL, "Failed to create window or renderer: %s", SDL_GetError());
-            do_exit(NULL);
+            do_exit();
         }
+    } else {
+        startup_mark(STARTUP_RENDERER, 1);
     }
 
-    is = stream_open(input_filename, file_iformat);
-    if (!is) {
-        av_log(NULL, AV_LOG_FATAL, "Failed to initialize VideoState!\n");
-        do_exit(NULL);
-    }
-
-    event_loop(is);
+    event_loop();
 
     /* never returns */
 